@@ -0,0 +1,676 @@
+/*
+ * GTK uxtheme implementation
+ *
+ * Copyright (C) 2015 Ivan Akulinchev
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "uxthemegtk.h"
+
+#include <stdlib.h>
+
+#include "winbase.h"
+#include "wingdi.h"
+#include "winuser.h"
+#include "winerror.h"
+#include "uxtheme.h"
+
+#include "wine/debug.h"
+#include "wine/list.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(uxthemegtk);
+
+#define ANIMATION_FRAME_INTERVAL 16 /* ms, about 60 frames per second */
+
+typedef struct _paint_buffer
+{
+    uxgtk_dib_t *dib;
+    HDC target_hdc;
+    RECT rect; /* in logical coordinates of the target DC */
+    int saved_dc;
+    BOOL use_blend;
+    BLENDFUNCTION blend;
+} paint_buffer_t;
+
+typedef struct _animation
+{
+    struct list entry;
+    HWND hwnd;
+    paint_buffer_t *from; /* NULL if nothing is animated */
+    paint_buffer_t *to;
+    BP_ANIMATIONSTYLE style;
+    DWORD duration;
+    DWORD start;
+} animation_t;
+
+static LONG init_count = 0;
+
+static struct list animations = LIST_INIT(animations);
+
+static CRITICAL_SECTION animation_cs;
+static CRITICAL_SECTION_DEBUG animation_cs_debug =
+{
+    0, 0, &animation_cs,
+    { &animation_cs_debug.ProcessLocksList, &animation_cs_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": animation_cs") }
+};
+static CRITICAL_SECTION animation_cs = { &animation_cs_debug, -1, 0, 0, 0, 0 };
+
+static paint_buffer_t *get_buffer(HPAINTBUFFER hbuffer)
+{
+    return (paint_buffer_t *)hbuffer;
+}
+
+/* Returns the row of the buffer, y is relative to the target rect */
+static unsigned char *get_row(const paint_buffer_t *buffer, int y)
+{
+    const uxgtk_dib_t *dib = buffer->dib;
+
+    if (!dib->top_down)
+        y = dib->height - 1 - y;
+
+    return dib->bits + y * dib->stride;
+}
+
+/* Converts the rect to the buffer coordinates, NULL means the whole buffer */
+static BOOL get_buffer_rect(const paint_buffer_t *buffer, const RECT *rect, RECT *result)
+{
+    if (rect == NULL)
+    {
+        *result = buffer->rect;
+    }
+    else if (!IntersectRect(result, rect, &buffer->rect))
+    {
+        return FALSE;
+    }
+
+    OffsetRect(result, -buffer->rect.left, -buffer->rect.top);
+
+    return TRUE;
+}
+
+HRESULT WINAPI BufferedPaintInit(void)
+{
+    TRACE("()\n");
+
+    InterlockedIncrement(&init_count);
+
+    return S_OK;
+}
+
+HRESULT WINAPI BufferedPaintUnInit(void)
+{
+    TRACE("()\n");
+
+    if (InterlockedDecrement(&init_count) < 0)
+    {
+        InterlockedIncrement(&init_count);
+        return E_UNEXPECTED;
+    }
+
+    return S_OK;
+}
+
+static paint_buffer_t *create_buffer(HDC target_hdc, const RECT *rect, BP_BUFFERFORMAT format,
+                                     const BP_PAINTPARAMS *params)
+{
+    int bpp = 32;
+    BOOL top_down = TRUE;
+    RECT clip_box;
+    paint_buffer_t *buffer;
+    int width, height;
+
+    width = rect->right - rect->left;
+    height = rect->bottom - rect->top;
+
+    switch (format)
+    {
+        case BPBF_COMPATIBLEBITMAP:
+            /* DIB sections are compatible with every DC and can be reused */
+        case BPBF_TOPDOWNDIB:
+            break;
+
+        case BPBF_DIB:
+            top_down = FALSE;
+            break;
+
+        case BPBF_TOPDOWNMONODIB:
+            bpp = 1;
+            break;
+
+        default:
+            FIXME("Unknown buffer format %d.\n", format);
+            return NULL;
+    }
+
+    buffer = malloc(sizeof(paint_buffer_t));
+    if (buffer == NULL)
+        return NULL;
+
+    buffer->dib = uxgtk_dib_acquire_format(width, height, bpp, top_down);
+
+    if (buffer->dib == NULL)
+    {
+        free(buffer);
+        return NULL;
+    }
+
+    buffer->target_hdc = target_hdc;
+    buffer->rect = *rect;
+    buffer->use_blend = FALSE;
+
+    /* Pooled DCs are shared, so the application must not change them for good */
+    buffer->saved_dc = SaveDC(buffer->dib->hdc);
+
+    /* The application paints in the coordinates of the target */
+    SetWindowOrgEx(buffer->dib->hdc, rect->left, rect->top, NULL);
+    IntersectClipRect(buffer->dib->hdc, rect->left, rect->top, rect->right, rect->bottom);
+
+    if (params != NULL)
+    {
+        if (!(params->dwFlags & BPPF_NOCLIP) && GetClipBox(target_hdc, &clip_box) != ERROR)
+        {
+            IntersectClipRect(buffer->dib->hdc, clip_box.left, clip_box.top,
+                              clip_box.right, clip_box.bottom);
+        }
+
+        if (params->prcExclude != NULL)
+        {
+            ExcludeClipRect(buffer->dib->hdc, params->prcExclude->left, params->prcExclude->top,
+                            params->prcExclude->right, params->prcExclude->bottom);
+        }
+
+        if (params->pBlendFunction != NULL)
+        {
+            buffer->use_blend = TRUE;
+            buffer->blend = *params->pBlendFunction;
+        }
+
+        if (params->dwFlags & BPPF_ERASE)
+            BufferedPaintClear((HPAINTBUFFER)buffer, NULL);
+    }
+
+    return buffer;
+}
+
+/* The application doesn't paint anymore, so the DC can be used for blitting */
+static void finish_buffer(paint_buffer_t *buffer)
+{
+    RestoreDC(buffer->dib->hdc, buffer->saved_dc);
+}
+
+static void destroy_buffer(paint_buffer_t *buffer)
+{
+    uxgtk_dib_release(buffer->dib);
+    free(buffer);
+}
+
+/* Must be called after finish_buffer */
+static void paint_buffer(const paint_buffer_t *buffer, uxgtk_dib_t *dib, HDC hdc)
+{
+    int width = buffer->rect.right - buffer->rect.left;
+    int height = buffer->rect.bottom - buffer->rect.top;
+
+    if (buffer->use_blend)
+    {
+        GdiAlphaBlend(hdc, buffer->rect.left, buffer->rect.top, width, height,
+                      dib->hdc, 0, 0, width, height, buffer->blend);
+    }
+    else
+    {
+        BitBlt(hdc, buffer->rect.left, buffer->rect.top, width, height,
+               dib->hdc, 0, 0, SRCCOPY);
+    }
+}
+
+HPAINTBUFFER WINAPI BeginBufferedPaint(HDC target_hdc, const RECT *rect, BP_BUFFERFORMAT format,
+                                       BP_PAINTPARAMS *params, HDC *hdc)
+{
+    paint_buffer_t *buffer;
+
+    TRACE("(%p, %p, %d, %p, %p)\n", target_hdc, rect, format, params, hdc);
+
+    if (hdc != NULL)
+        *hdc = NULL;
+
+    if (target_hdc == NULL || rect == NULL || hdc == NULL || IsRectEmpty(rect))
+        return NULL;
+
+    buffer = create_buffer(target_hdc, rect, format, params);
+
+    if (buffer == NULL)
+        return NULL;
+
+    *hdc = buffer->dib->hdc;
+
+    return (HPAINTBUFFER)buffer;
+}
+
+HRESULT WINAPI EndBufferedPaint(HPAINTBUFFER hbuffer, BOOL update_target)
+{
+    paint_buffer_t *buffer = get_buffer(hbuffer);
+
+    TRACE("(%p, %d)\n", hbuffer, update_target);
+
+    if (buffer == NULL)
+        return E_INVALIDARG;
+
+    finish_buffer(buffer);
+
+    if (update_target)
+        paint_buffer(buffer, buffer->dib, buffer->target_hdc);
+
+    destroy_buffer(buffer);
+
+    return S_OK;
+}
+
+HRESULT WINAPI BufferedPaintClear(HPAINTBUFFER hbuffer, const RECT *rect)
+{
+    paint_buffer_t *buffer = get_buffer(hbuffer);
+    RECT area;
+    int y;
+
+    TRACE("(%p, %p)\n", hbuffer, rect);
+
+    if (buffer == NULL)
+        return E_INVALIDARG;
+
+    if (!get_buffer_rect(buffer, rect, &area))
+        return S_OK;
+
+    if (buffer->dib->bpp != 32)
+    {
+        PatBlt(buffer->dib->hdc, area.left + buffer->rect.left, area.top + buffer->rect.top,
+               area.right - area.left, area.bottom - area.top, BLACKNESS);
+        return S_OK;
+    }
+
+    GdiFlush();
+
+    for (y = area.top; y < area.bottom; y++)
+        memset(get_row(buffer, y) + area.left * 4, 0, (area.right - area.left) * 4);
+
+    return S_OK;
+}
+
+HRESULT WINAPI BufferedPaintSetAlpha(HPAINTBUFFER hbuffer, const RECT *rect, BYTE alpha)
+{
+    paint_buffer_t *buffer = get_buffer(hbuffer);
+    RECT area;
+    int x, y;
+
+    TRACE("(%p, %p, %d)\n", hbuffer, rect, alpha);
+
+    if (buffer == NULL)
+        return E_INVALIDARG;
+
+    if (buffer->dib->bpp != 32)
+        return E_NOTIMPL;
+
+    if (!get_buffer_rect(buffer, rect, &area))
+        return S_OK;
+
+    GdiFlush();
+
+    for (y = area.top; y < area.bottom; y++)
+    {
+        unsigned char *row = get_row(buffer, y);
+
+        for (x = area.left; x < area.right; x++)
+            row[x * 4 + 3] = alpha;
+    }
+
+    return S_OK;
+}
+
+HRESULT WINAPI GetBufferedPaintBits(HPAINTBUFFER hbuffer, RGBQUAD **bits, int *row_width)
+{
+    paint_buffer_t *buffer = get_buffer(hbuffer);
+
+    TRACE("(%p, %p, %p)\n", hbuffer, bits, row_width);
+
+    if (buffer == NULL || bits == NULL || row_width == NULL)
+        return E_INVALIDARG;
+
+    GdiFlush();
+
+    *bits = (RGBQUAD *)buffer->dib->bits;
+    *row_width = buffer->dib->stride * 8 / buffer->dib->bpp;
+
+    return S_OK;
+}
+
+HDC WINAPI GetBufferedPaintDC(HPAINTBUFFER hbuffer)
+{
+    paint_buffer_t *buffer = get_buffer(hbuffer);
+
+    TRACE("(%p)\n", hbuffer);
+
+    return buffer != NULL ? buffer->dib->hdc : NULL;
+}
+
+HDC WINAPI GetBufferedPaintTargetDC(HPAINTBUFFER hbuffer)
+{
+    paint_buffer_t *buffer = get_buffer(hbuffer);
+
+    TRACE("(%p)\n", hbuffer);
+
+    return buffer != NULL ? buffer->target_hdc : NULL;
+}
+
+HRESULT WINAPI GetBufferedPaintTargetRect(HPAINTBUFFER hbuffer, RECT *rect)
+{
+    paint_buffer_t *buffer = get_buffer(hbuffer);
+
+    TRACE("(%p, %p)\n", hbuffer, rect);
+
+    if (buffer == NULL || rect == NULL)
+        return E_INVALIDARG;
+
+    *rect = buffer->rect;
+
+    return S_OK;
+}
+
+static void destroy_animation(animation_t *animation)
+{
+    if (animation->from != NULL)
+        destroy_buffer(animation->from);
+
+    destroy_buffer(animation->to);
+    free(animation);
+}
+
+/* Must be called with animation_cs held */
+static void remove_animation(animation_t *animation)
+{
+    list_remove(&animation->entry);
+    KillTimer(animation->hwnd, (UINT_PTR)animation);
+    destroy_animation(animation);
+}
+
+/* Drops the animations of destroyed windows, must be called with animation_cs held */
+static void prune_animations(void)
+{
+    animation_t *animation, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE(animation, next, &animations, animation_t, entry)
+    {
+        if (!IsWindow(animation->hwnd))
+            remove_animation(animation);
+    }
+}
+
+/* Returns the progress in 1/256, the elapsed time must be less than the duration */
+static int get_progress(BP_ANIMATIONSTYLE style, DWORD elapsed, DWORD duration)
+{
+    int t = (int)((ULONGLONG)elapsed * 256 / duration);
+    int u;
+
+    switch (style)
+    {
+        case BPAS_CUBIC:
+            /* 1 - (1 - t)^3 */
+            u = 256 - t;
+            return 256 - u * u / 256 * u / 256;
+
+        case BPAS_SINE:
+            /* sin(t * pi / 2), Bhaskara's approximation: 4u / (5 - u) with u = t(2 - t) */
+            u = t * (512 - t) / 256;
+            return 4 * u * 256 / (5 * 256 - u);
+
+        default:
+            return t;
+    }
+}
+
+/* Intermediate frames are mixed from the cached bitmaps, nothing is painted again */
+static void paint_frame(const animation_t *animation, HDC hdc, int progress)
+{
+    const paint_buffer_t *from = animation->from;
+    const paint_buffer_t *to = animation->to;
+    int width = to->rect.right - to->rect.left;
+    int height = to->rect.bottom - to->rect.top;
+    uxgtk_dib_t *frame;
+
+    frame = uxgtk_dib_acquire(width, height);
+
+    if (frame == NULL)
+    {
+        paint_buffer(to, to->dib, hdc);
+        return;
+    }
+
+    GdiFlush();
+
+    uxgtk_pixels_mix(frame->bits, frame->stride, from->dib->bits, from->dib->stride,
+                     to->dib->bits, to->dib->stride, width, height, progress);
+
+    paint_buffer(to, frame, hdc);
+
+    uxgtk_dib_release(frame);
+}
+
+static void CALLBACK animation_timer_proc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time)
+{
+    animation_t *animation;
+    BOOL found = FALSE;
+
+    EnterCriticalSection(&animation_cs);
+
+    LIST_FOR_EACH_ENTRY(animation, &animations, animation_t, entry)
+    {
+        if ((UINT_PTR)animation != id || animation->hwnd != hwnd)
+            continue;
+
+        InvalidateRect(hwnd, &animation->to->rect, FALSE);
+
+        /* The application paints the final state itself */
+        if (GetTickCount() - animation->start >= animation->duration)
+            remove_animation(animation);
+
+        found = TRUE;
+        break;
+    }
+
+    LeaveCriticalSection(&animation_cs);
+
+    if (!found)
+        KillTimer(hwnd, id);
+}
+
+HANIMATIONBUFFER WINAPI BeginBufferedAnimation(HWND hwnd, HDC target_hdc, const RECT *rect,
+                                               BP_BUFFERFORMAT format,
+                                               BP_PAINTPARAMS *paint_params,
+                                               BP_ANIMATIONPARAMS *animation_params,
+                                               HDC *hdc_from, HDC *hdc_to)
+{
+    animation_t *animation, *next;
+    RECT intersection;
+
+    TRACE("(%p, %p, %p, %d, %p, %p, %p, %p)\n", hwnd, target_hdc, rect, format,
+          paint_params, animation_params, hdc_from, hdc_to);
+
+    if (hdc_from != NULL)
+        *hdc_from = NULL;
+
+    if (hdc_to != NULL)
+        *hdc_to = NULL;
+
+    if (hwnd == NULL || target_hdc == NULL || rect == NULL || hdc_to == NULL ||
+        IsRectEmpty(rect))
+        return NULL;
+
+    /* A new transition replaces the running one */
+    EnterCriticalSection(&animation_cs);
+
+    prune_animations();
+
+    LIST_FOR_EACH_ENTRY_SAFE(animation, next, &animations, animation_t, entry)
+    {
+        if (animation->hwnd == hwnd && IntersectRect(&intersection, &animation->to->rect, rect))
+            remove_animation(animation);
+    }
+
+    LeaveCriticalSection(&animation_cs);
+
+    animation = malloc(sizeof(animation_t));
+    if (animation == NULL)
+        return NULL;
+
+    animation->hwnd = hwnd;
+    animation->from = NULL;
+    animation->style = BPAS_NONE;
+    animation->duration = 0;
+    animation->start = 0;
+
+    if (hdc_from != NULL && animation_params != NULL &&
+        animation_params->style != BPAS_NONE && animation_params->dwDuration > 0)
+    {
+        /* Frames are mixed in-DLL, so both buffers must be 32 bpp top-down DIBs */
+        format = BPBF_TOPDOWNDIB;
+
+        animation->from = create_buffer(target_hdc, rect, format, paint_params);
+
+        if (animation->from == NULL)
+        {
+            free(animation);
+            return NULL;
+        }
+
+        animation->style = animation_params->style;
+        animation->duration = animation_params->dwDuration;
+    }
+
+    animation->to = create_buffer(target_hdc, rect, format, paint_params);
+
+    if (animation->to == NULL)
+    {
+        if (animation->from != NULL)
+            destroy_buffer(animation->from);
+
+        free(animation);
+        return NULL;
+    }
+
+    if (animation->from != NULL)
+        *hdc_from = animation->from->dib->hdc;
+
+    *hdc_to = animation->to->dib->hdc;
+
+    return (HANIMATIONBUFFER)animation;
+}
+
+HRESULT WINAPI EndBufferedAnimation(HANIMATIONBUFFER hanimation, BOOL update_target)
+{
+    animation_t *animation = (animation_t *)hanimation;
+
+    TRACE("(%p, %d)\n", hanimation, update_target);
+
+    if (animation == NULL)
+        return E_INVALIDARG;
+
+    if (animation->from != NULL)
+        finish_buffer(animation->from);
+
+    finish_buffer(animation->to);
+
+    if (!update_target || animation->from == NULL)
+    {
+        if (update_target)
+            paint_buffer(animation->to, animation->to->dib, animation->to->target_hdc);
+
+        destroy_animation(animation);
+        return S_OK;
+    }
+
+    /* The first frame is the old state */
+    paint_buffer(animation->from, animation->from->dib, animation->from->target_hdc);
+
+    animation->start = GetTickCount();
+
+    EnterCriticalSection(&animation_cs);
+    list_add_tail(&animations, &animation->entry);
+    LeaveCriticalSection(&animation_cs);
+
+    /* Timers only fire on the thread of the window, others drive the frames from WM_PAINT */
+    if (GetWindowThreadProcessId(animation->hwnd, NULL) == GetCurrentThreadId())
+        SetTimer(animation->hwnd, (UINT_PTR)animation, ANIMATION_FRAME_INTERVAL,
+                 animation_timer_proc);
+
+    return S_OK;
+}
+
+BOOL WINAPI BufferedPaintRenderAnimation(HWND hwnd, HDC hdc)
+{
+    animation_t *animation, *next;
+    DWORD elapsed, now = GetTickCount();
+    BOOL painted = FALSE;
+
+    TRACE("(%p, %p)\n", hwnd, hdc);
+
+    EnterCriticalSection(&animation_cs);
+
+    prune_animations();
+
+    LIST_FOR_EACH_ENTRY_SAFE(animation, next, &animations, animation_t, entry)
+    {
+        if (animation->hwnd != hwnd)
+            continue;
+
+        elapsed = now - animation->start;
+
+        if (elapsed >= animation->duration)
+        {
+            remove_animation(animation);
+            continue;
+        }
+
+        paint_frame(animation, hdc, get_progress(animation->style, elapsed,
+                                                 animation->duration));
+        painted = TRUE;
+    }
+
+    LeaveCriticalSection(&animation_cs);
+
+    return painted;
+}
+
+HRESULT WINAPI BufferedPaintStopAllAnimations(HWND hwnd)
+{
+    animation_t *animation, *next;
+
+    TRACE("(%p)\n", hwnd);
+
+    EnterCriticalSection(&animation_cs);
+
+    prune_animations();
+
+    LIST_FOR_EACH_ENTRY_SAFE(animation, next, &animations, animation_t, entry)
+    {
+        if (animation->hwnd != hwnd)
+            continue;
+
+        /* Let the application paint the final state */
+        InvalidateRect(hwnd, &animation->to->rect, FALSE);
+        remove_animation(animation);
+    }
+
+    LeaveCriticalSection(&animation_cs);
+
+    return S_OK;
+}
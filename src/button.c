@@ -54,12 +54,14 @@ static HRESULT draw_background(uxgtk_theme_t *theme, cairo_t *cr, int part_id, i
 static HRESULT get_part_size(uxgtk_theme_t *theme, int part_id, int state_id,
                              RECT *rect, SIZE *size);
 static BOOL is_part_defined(int part_id, int state_id);
+static GtkStyleContext *get_stretch_context(uxgtk_theme_t *theme, int part_id, int state_id);
 
 static const uxgtk_theme_vtable_t button_vtable = {
     get_color,
     draw_background,
     get_part_size,
-    is_part_defined
+    is_part_defined,
+    get_stretch_context
 };
 
 static GtkWidget *get_button(button_theme_t *theme)
@@ -300,15 +302,9 @@ static HRESULT get_border_color(button_theme_t *theme, int part_id, int state_id
             return E_NOTIMPL;
     }
 
-    context = pgtk_widget_get_style_context(get_frame(theme));
-
-    pgtk_style_context_save(context);
-
-    pgtk_style_context_add_class(context, GTK_STYLE_CLASS_FRAME);
+    context = uxgtk_style_get(&theme->base, get_frame(theme), state, GTK_STYLE_CLASS_FRAME);
     pgtk_style_context_get_border_color(context, state, rgba);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
@@ -369,41 +365,32 @@ static HRESULT get_color(uxgtk_theme_t *theme, int part_id, int state_id,
     return E_NOTIMPL;
 }
 
-static HRESULT draw_button(button_theme_t *theme, cairo_t *cr, int state_id, int width, int height)
+static GtkStyleContext *get_push_button_context(button_theme_t *theme, int state_id)
 {
-    GtkStateFlags state = get_push_button_state_flags(state_id);
-    GtkStyleContext *context = pgtk_widget_get_style_context(get_button(theme));
-
-    pgtk_style_context_save(context);
-
-    pgtk_style_context_set_state(context, state);
+    return uxgtk_style_get(&theme->base, get_button(theme), get_push_button_state_flags(state_id),
+                           state_id == PBS_DEFAULTED ? GTK_STYLE_CLASS_DEFAULT : NULL);
+}
 
-    if (state_id == PBS_DEFAULTED)
-        pgtk_style_context_add_class(context, GTK_STYLE_CLASS_DEFAULT);
+static HRESULT draw_button(button_theme_t *theme, cairo_t *cr, int state_id, int width, int height)
+{
+    GtkStyleContext *context = get_push_button_context(theme, state_id);
 
     pgtk_render_background(context, cr, 0, 0, width, height);
     pgtk_render_frame(context, cr, 0, 0, width, height);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
 static HRESULT draw_radio(button_theme_t *theme, cairo_t *cr, int state_id)
 {
     GtkStateFlags state = get_radio_button_state_flags(state_id);
-    GtkStyleContext *context = pgtk_widget_get_style_context(get_radio(theme));
-
-    pgtk_style_context_save(context);
-
-    pgtk_style_context_set_state(context, state);
-    pgtk_style_context_add_class(context, GTK_STYLE_CLASS_RADIO);
+    GtkStyleContext *context;
 
     assert(theme != NULL);
 
-    pgtk_render_option(context, cr, 0, 0, theme->indicator_size, theme->indicator_size);
+    context = uxgtk_style_get(&theme->base, get_radio(theme), state, GTK_STYLE_CLASS_RADIO);
 
-    pgtk_style_context_restore(context);
+    pgtk_render_option(context, cr, 0, 0, theme->indicator_size, theme->indicator_size);
 
     return S_OK;
 }
@@ -415,17 +402,10 @@ static HRESULT draw_checkbox(button_theme_t *theme, cairo_t *cr, int state_id)
 
     assert(theme != NULL);
 
-    context = pgtk_widget_get_style_context(theme->check);
-
-    pgtk_style_context_save(context);
-
-    pgtk_style_context_set_state(context, state);
-    pgtk_style_context_add_class(context, GTK_STYLE_CLASS_CHECK);
+    context = uxgtk_style_get(&theme->base, theme->check, state, GTK_STYLE_CLASS_CHECK);
 
     pgtk_render_check(context, cr, 0, 0, theme->indicator_size, theme->indicator_size);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
@@ -484,6 +464,14 @@ static BOOL is_part_defined(int part_id, int state_id)
     return (part_id > 0 && part_id < BP_COMMANDLINK);
 }
 
+static GtkStyleContext *get_stretch_context(uxgtk_theme_t *theme, int part_id, int state_id)
+{
+    if (part_id == BP_PUSHBUTTON)
+        return get_push_button_context((button_theme_t *)theme, state_id);
+
+    return NULL;
+}
+
 uxgtk_theme_t *uxgtk_button_theme_create(void)
 {
     button_theme_t *theme;
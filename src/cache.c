@@ -0,0 +1,538 @@
+/*
+ * GTK uxtheme implementation
+ *
+ * Copyright (C) 2015 Ivan Akulinchev
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * The cache is read far more often than it is written, so lookups don't
+ * take any lock. Writers are serialized by cache_cs, they publish new
+ * entries with a single pointer store and never free an unlinked entry
+ * right away. Instead it is retired with the current epoch and freed once
+ * every reader that might still see it has left its read section. Hence
+ * the pixels are handed to a callback running inside that section, which
+ * needs no reference counting on the hot path.
+ */
+
+#include "uxthemegtk.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "winbase.h"
+
+#include "wine/debug.h"
+#include "wine/list.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(uxthemegtk);
+
+#define CACHE_BUCKETS 256
+#define CACHE_MAX_BYTES (8 * 1024 * 1024)
+#define CACHE_MAX_ENTRY_BYTES (256 * 1024)
+#define OPACITY_BUCKETS 64
+#define MAX_READERS 64
+
+struct cache_entry
+{
+    uxgtk_bitmap_t bitmap;
+
+    uxgtk_cache_key_t key;
+    unsigned int hash;
+    volatile LONG referenced; /* set by readers, cleared by the clock hand */
+
+    struct cache_entry * volatile next;
+    struct list lru_entry; /* only touched by writers */
+
+    struct cache_entry *retired_next;
+    LONG retired_epoch;
+};
+
+struct opacity_entry
+{
+    const uxgtk_theme_vtable_t *vtable;
+    int part_id;
+    int state_id;
+    volatile uxgtk_opacity_t opacity;
+
+    struct opacity_entry * volatile next;
+
+    struct opacity_entry *retired_next;
+    LONG retired_epoch;
+};
+
+/* One per thread, on its own cache line to keep readers from bouncing it */
+struct reader_slot
+{
+    volatile LONG owner;
+    volatile LONG epoch; /* 0 if the thread is not reading */
+    char padding[64 - 2 * sizeof(LONG)];
+};
+
+static struct cache_entry * volatile buckets[CACHE_BUCKETS];
+static struct opacity_entry * volatile opacity_buckets[OPACITY_BUCKETS];
+static struct list lru = LIST_INIT(lru);
+static size_t cache_bytes = 0;
+
+static struct reader_slot readers[MAX_READERS];
+static volatile LONG global_epoch = 1;
+static struct cache_entry *retired_entries = NULL;
+static struct opacity_entry *retired_opacities = NULL;
+static DWORD tls_index = TLS_OUT_OF_INDEXES;
+
+static CRITICAL_SECTION cache_cs;
+static CRITICAL_SECTION_DEBUG cache_cs_debug =
+{
+    0, 0, &cache_cs,
+    { &cache_cs_debug.ProcessLocksList, &cache_cs_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": cache_cs") }
+};
+static CRITICAL_SECTION cache_cs = { &cache_cs_debug, -1, 0, 0, 0, 0 };
+
+static unsigned int hash_key(const uxgtk_cache_key_t *key)
+{
+    unsigned int hash = (unsigned int)((ULONG_PTR)key->vtable >> 4);
+
+    hash = hash * 31 + key->part_id;
+    hash = hash * 31 + key->state_id;
+    hash = hash * 31 + key->width;
+    hash = hash * 31 + key->height;
+
+    return hash ^ (hash >> 16);
+}
+
+static BOOL equal_keys(const uxgtk_cache_key_t *a, const uxgtk_cache_key_t *b)
+{
+    return (a->vtable == b->vtable && a->part_id == b->part_id && a->state_id == b->state_id &&
+            a->width == b->width && a->height == b->height);
+}
+
+/* Returns the reader slot of the current thread, or NULL if all are taken */
+static struct reader_slot *get_reader_slot(void)
+{
+    LONG i, thread_id = GetCurrentThreadId();
+    ULONG_PTR index;
+
+    if (tls_index == TLS_OUT_OF_INDEXES)
+        return NULL;
+
+    index = (ULONG_PTR)TlsGetValue(tls_index);
+
+    if (index != 0)
+        return &readers[index - 1];
+
+    for (i = 0; i < MAX_READERS; i++)
+    {
+        if (InterlockedCompareExchange(&readers[i].owner, thread_id, 0) == 0)
+        {
+            TlsSetValue(tls_index, (void *)(ULONG_PTR)(i + 1));
+            return &readers[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Everything found between begin_read and end_read stays valid until
+ * end_read. Threads without a slot simply take the writer lock.
+ */
+static struct reader_slot *begin_read(void)
+{
+    struct reader_slot *slot = get_reader_slot();
+
+    if (slot == NULL)
+    {
+        EnterCriticalSection(&cache_cs);
+        return NULL;
+    }
+
+    slot->epoch = global_epoch;
+    MemoryBarrier(); /* the epoch must be visible before the first bucket read */
+
+    return slot;
+}
+
+static void end_read(struct reader_slot *slot)
+{
+    if (slot == NULL)
+    {
+        LeaveCriticalSection(&cache_cs);
+        return;
+    }
+
+    MemoryBarrier();
+    slot->epoch = 0;
+}
+
+/* Must be called with cache_cs held */
+static void reclaim(void)
+{
+    int i;
+    LONG epoch, oldest;
+    struct cache_entry *entry, **entry_ptr;
+    struct opacity_entry *opacity, **opacity_ptr;
+
+    if (retired_entries == NULL && retired_opacities == NULL)
+        return;
+
+    /* Readers that start from now on can't see anything retired so far */
+    oldest = InterlockedIncrement(&global_epoch);
+
+    for (i = 0; i < MAX_READERS; i++)
+    {
+        epoch = readers[i].epoch;
+
+        if (epoch != 0 && epoch < oldest)
+            oldest = epoch;
+    }
+
+    entry_ptr = &retired_entries;
+
+    while ((entry = *entry_ptr) != NULL)
+    {
+        if (entry->retired_epoch < oldest)
+        {
+            *entry_ptr = entry->retired_next;
+            free(entry->bitmap.data);
+            free(entry);
+        }
+        else
+        {
+            entry_ptr = &entry->retired_next;
+        }
+    }
+
+    opacity_ptr = &retired_opacities;
+
+    while ((opacity = *opacity_ptr) != NULL)
+    {
+        if (opacity->retired_epoch < oldest)
+        {
+            *opacity_ptr = opacity->retired_next;
+            free(opacity);
+        }
+        else
+        {
+            opacity_ptr = &opacity->retired_next;
+        }
+    }
+}
+
+/* Must be called with cache_cs held */
+static void evict_entry(struct cache_entry *entry)
+{
+    struct cache_entry * volatile *ptr = &buckets[entry->hash % CACHE_BUCKETS];
+
+    while (*ptr != entry)
+        ptr = &(*ptr)->next;
+
+    /* Readers standing on the entry still see the rest of the chain */
+    *ptr = entry->next;
+
+    list_remove(&entry->lru_entry);
+    cache_bytes -= entry->bitmap.stride * entry->bitmap.height;
+
+    entry->retired_epoch = global_epoch;
+    entry->retired_next = retired_entries;
+    retired_entries = entry;
+}
+
+/* Second chance: recently used entries are skipped once */
+static void evict_one(void)
+{
+    struct list *tail;
+    struct cache_entry *entry;
+
+    while ((tail = list_tail(&lru)) != NULL)
+    {
+        entry = LIST_ENTRY(tail, struct cache_entry, lru_entry);
+
+        if (InterlockedExchange(&entry->referenced, 0) == 0)
+        {
+            evict_entry(entry);
+            return;
+        }
+
+        list_remove(&entry->lru_entry);
+        list_add_head(&lru, &entry->lru_entry);
+    }
+}
+
+BOOL uxgtk_cache_accepts(int width, int height)
+{
+    return (width > 0 && height > 0 && (size_t)width * height * 4 <= CACHE_MAX_ENTRY_BYTES);
+}
+
+/*
+ * Calls func with the cached bitmap, returns FALSE if there is none. The
+ * bitmap is only valid during the call and func must not use the cache.
+ */
+BOOL uxgtk_cache_lookup(const uxgtk_cache_key_t *key, uxgtk_cache_read_func_t func,
+                        void *context)
+{
+    struct reader_slot *slot;
+    struct cache_entry *entry;
+    unsigned int hash = hash_key(key);
+
+    slot = begin_read();
+
+    for (entry = buckets[hash % CACHE_BUCKETS]; entry != NULL; entry = entry->next)
+    {
+        if (entry->hash == hash && equal_keys(&entry->key, key))
+        {
+            /* Avoid dirtying the cache line when the flag is already set */
+            if (!entry->referenced)
+                entry->referenced = 1;
+
+            func(&entry->bitmap, context);
+            break;
+        }
+    }
+
+    end_read(slot);
+
+    return (entry != NULL);
+}
+
+BOOL uxgtk_cache_insert(const uxgtk_cache_key_t *key, const unsigned char *data, int stride,
+                        BOOL opaque)
+{
+    int i, row_size;
+    size_t size;
+    struct cache_entry *entry, *old;
+    unsigned int hash = hash_key(key);
+
+    assert(data != NULL);
+
+    row_size = key->width * 4;
+    size = (size_t)row_size * key->height;
+
+    if (!uxgtk_cache_accepts(key->width, key->height))
+        return FALSE;
+
+    entry = malloc(sizeof(*entry));
+    if (entry == NULL)
+        return FALSE;
+
+    entry->bitmap.data = malloc(size);
+    if (entry->bitmap.data == NULL)
+    {
+        free(entry);
+        return FALSE;
+    }
+
+    entry->bitmap.width = key->width;
+    entry->bitmap.height = key->height;
+    entry->bitmap.stride = row_size;
+    entry->bitmap.opaque = opaque;
+
+    for (i = 0; i < key->height; i++)
+        memcpy(entry->bitmap.data + i * row_size, data + i * stride, row_size);
+
+    entry->key = *key;
+    entry->hash = hash;
+    entry->referenced = 0;
+
+    EnterCriticalSection(&cache_cs);
+
+    /* Another thread might have rendered the same part meanwhile */
+    for (old = buckets[hash % CACHE_BUCKETS]; old != NULL; old = old->next)
+    {
+        if (old->hash == hash && equal_keys(&old->key, key))
+        {
+            evict_entry(old);
+            break;
+        }
+    }
+
+    while (cache_bytes + size > CACHE_MAX_BYTES && !list_empty(&lru))
+        evict_one();
+
+    entry->next = buckets[hash % CACHE_BUCKETS];
+    MemoryBarrier(); /* readers must never see a half-initialized entry */
+    buckets[hash % CACHE_BUCKETS] = entry;
+
+    list_add_head(&lru, &entry->lru_entry);
+    cache_bytes += size;
+
+    reclaim();
+
+    LeaveCriticalSection(&cache_cs);
+
+    return TRUE;
+}
+
+void uxgtk_cache_flush(void)
+{
+    int i;
+    struct cache_entry *entry, *next;
+    struct opacity_entry *opacity, *next_opacity;
+
+    EnterCriticalSection(&cache_cs);
+
+    LIST_FOR_EACH_ENTRY_SAFE(entry, next, &lru, struct cache_entry, lru_entry)
+        evict_entry(entry);
+
+    for (i = 0; i < OPACITY_BUCKETS; i++)
+    {
+        opacity = opacity_buckets[i];
+        opacity_buckets[i] = NULL;
+
+        for (; opacity != NULL; opacity = next_opacity)
+        {
+            next_opacity = opacity->next;
+
+            opacity->retired_epoch = global_epoch;
+            opacity->retired_next = retired_opacities;
+            retired_opacities = opacity;
+        }
+    }
+
+    reclaim();
+
+    LeaveCriticalSection(&cache_cs);
+}
+
+static unsigned int hash_part(const uxgtk_theme_vtable_t *vtable, int part_id, int state_id)
+{
+    unsigned int hash = (unsigned int)((ULONG_PTR)vtable >> 4);
+
+    hash = hash * 31 + part_id;
+    hash = hash * 31 + state_id;
+
+    return (hash ^ (hash >> 16)) % OPACITY_BUCKETS;
+}
+
+static struct opacity_entry *find_opacity(unsigned int hash, const uxgtk_theme_vtable_t *vtable,
+                                          int part_id, int state_id)
+{
+    struct opacity_entry *entry;
+
+    for (entry = opacity_buckets[hash]; entry != NULL; entry = entry->next)
+    {
+        if (entry->vtable == vtable && entry->part_id == part_id && entry->state_id == state_id)
+            break;
+    }
+
+    return entry;
+}
+
+/* Once a part was seen with transparent pixels it is considered transparent */
+void uxgtk_opacity_update(const uxgtk_theme_vtable_t *vtable, int part_id, int state_id,
+                          BOOL opaque)
+{
+    struct reader_slot *slot;
+    struct opacity_entry *entry;
+    unsigned int hash = hash_part(vtable, part_id, state_id);
+    uxgtk_opacity_t opacity = opaque ? UXGTK_OPACITY_OPAQUE : UXGTK_OPACITY_TRANSPARENT;
+
+    /* Nearly always the part is already known, which needs no lock */
+    slot = begin_read();
+
+    entry = find_opacity(hash, vtable, part_id, state_id);
+
+    if (entry != NULL && opacity == UXGTK_OPACITY_TRANSPARENT)
+        entry->opacity = opacity;
+
+    end_read(slot);
+
+    if (entry != NULL)
+        return;
+
+    EnterCriticalSection(&cache_cs);
+
+    entry = find_opacity(hash, vtable, part_id, state_id);
+
+    if (entry == NULL)
+    {
+        entry = malloc(sizeof(*entry));
+
+        if (entry != NULL)
+        {
+            entry->vtable = vtable;
+            entry->part_id = part_id;
+            entry->state_id = state_id;
+            entry->opacity = opacity;
+            entry->next = opacity_buckets[hash];
+            MemoryBarrier();
+            opacity_buckets[hash] = entry;
+        }
+    }
+    else if (opacity == UXGTK_OPACITY_TRANSPARENT)
+    {
+        entry->opacity = opacity;
+    }
+
+    LeaveCriticalSection(&cache_cs);
+}
+
+uxgtk_opacity_t uxgtk_opacity_query(const uxgtk_theme_vtable_t *vtable, int part_id,
+                                    int state_id)
+{
+    struct reader_slot *slot;
+    struct opacity_entry *entry;
+    uxgtk_opacity_t opacity = UXGTK_OPACITY_UNKNOWN;
+    unsigned int hash = hash_part(vtable, part_id, state_id);
+
+    slot = begin_read();
+
+    entry = find_opacity(hash, vtable, part_id, state_id);
+
+    if (entry != NULL)
+        opacity = entry->opacity;
+
+    end_read(slot);
+
+    return opacity;
+}
+
+void uxgtk_cache_thread_detach(void)
+{
+    ULONG_PTR index;
+
+    if (tls_index == TLS_OUT_OF_INDEXES)
+        return;
+
+    index = (ULONG_PTR)TlsGetValue(tls_index);
+
+    if (index == 0)
+        return;
+
+    readers[index - 1].epoch = 0;
+    InterlockedExchange(&readers[index - 1].owner, 0);
+
+    TlsSetValue(tls_index, NULL);
+}
+
+void uxgtk_cache_init(void)
+{
+    tls_index = TlsAlloc();
+
+    if (tls_index == TLS_OUT_OF_INDEXES)
+        WARN("No TLS index, cache lookups will take a lock.\n");
+}
+
+void uxgtk_cache_uninit(void)
+{
+    uxgtk_cache_flush();
+    uxgtk_cache_thread_detach();
+
+    if (tls_index != TLS_OUT_OF_INDEXES)
+        TlsFree(tls_index);
+
+    tls_index = TLS_OUT_OF_INDEXES;
+}
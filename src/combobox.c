@@ -37,21 +37,23 @@ typedef struct _combobox_theme
     int arrow_size;
     float arrow_scaling;
 
-    GtkWidget *combobox;
-    GtkWidget *button;
-    GtkWidget *entry;
-    GtkWidget *arrow;
+    GtkStyleContext *combobox;
+    GtkStyleContext *button;
+    GtkStyleContext *entry;
+    GtkStyleContext *arrow;
 } combobox_theme_t;
 
 static HRESULT draw_background(uxgtk_theme_t *theme, cairo_t *cr, int part_id, int state_id,
                                int width, int height);
 static BOOL is_part_defined(int part_id, int state_id);
+static GtkStyleContext *get_stretch_context(uxgtk_theme_t *theme, int part_id, int state_id);
 
 static const uxgtk_theme_vtable_t combobox_vtable = {
     NULL, /* get_color */
     draw_background,
     NULL, /* get_part_size */
-    is_part_defined
+    is_part_defined,
+    get_stretch_context
 };
 
 static GtkStateFlags get_border_state_flags(int state_id)
@@ -96,32 +98,22 @@ static GtkStateFlags get_dropdown_button_state_flags(int state_id)
     return GTK_STATE_FLAG_NORMAL;
 }
 
-static void iter_callback(GtkWidget *widget, gpointer data)
+static GtkStyleContext *get_border_context(combobox_theme_t *theme, int state_id)
 {
-    assert(data != NULL);
-
-    if (pg_type_check_instance_is_a((GTypeInstance *)widget, pgtk_toggle_button_get_type()))
-        ((combobox_theme_t *)data)->button = widget;
+    return uxgtk_style_get_node(&theme->base, theme->entry, get_border_state_flags(state_id), NULL);
 }
 
 static HRESULT draw_border(combobox_theme_t *theme, cairo_t *cr, int state_id, int width, int height)
 {
     GtkStyleContext *context;
-    GtkStateFlags state = get_border_state_flags(state_id);
 
     assert(theme != NULL);
 
-    context = pgtk_widget_get_style_context(theme->entry);
-
-    pgtk_style_context_save(context);
-
-    pgtk_style_context_set_state(context, state);
+    context = get_border_context(theme, state_id);
 
     pgtk_render_background(context, cr, 0, 0, width, height);
     pgtk_render_frame(context, cr, 0, 0, width, height);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
@@ -134,12 +126,8 @@ static HRESULT draw_button(combobox_theme_t *theme, cairo_t *cr, int part_id, in
 
     assert(theme != NULL);
 
-    arrow_context = pgtk_widget_get_style_context(theme->arrow);
-    button_context = pgtk_widget_get_style_context(theme->button);
-
-    pgtk_style_context_save(button_context);
-
-    pgtk_style_context_set_state(button_context, state);
+    arrow_context = uxgtk_style_get_node(&theme->base, theme->arrow, state, NULL);
+    button_context = uxgtk_style_get_node(&theme->base, theme->button, state, NULL);
 
     /* Render with another size to remove a gap */
     if (part_id == CP_DROPDOWNBUTTONLEFT)
@@ -153,12 +141,6 @@ static HRESULT draw_button(combobox_theme_t *theme, cairo_t *cr, int part_id, in
         pgtk_render_frame(button_context, cr, 0, -2, width + 2, height + 4);
     }
 
-    pgtk_style_context_restore(button_context);
-
-    pgtk_style_context_save(arrow_context);
-
-    pgtk_style_context_set_state(arrow_context, state);
-
     arrow_width = theme->arrow_size * theme->arrow_scaling;
 
     arrow_x = (width - arrow_width + 3) / 2;
@@ -166,8 +148,6 @@ static HRESULT draw_button(combobox_theme_t *theme, cairo_t *cr, int part_id, in
 
     pgtk_render_arrow(arrow_context, cr, G_PI, arrow_x, arrow_y, arrow_width);
 
-    pgtk_style_context_restore(arrow_context);
-
     return S_OK;
 }
 
@@ -198,9 +178,18 @@ static BOOL is_part_defined(int part_id, int state_id)
             part_id == CP_DROPDOWNBUTTONLEFT || part_id == CP_DROPDOWNBUTTONRIGHT);
 }
 
+static GtkStyleContext *get_stretch_context(uxgtk_theme_t *theme, int part_id, int state_id)
+{
+    if (part_id == 0 || part_id == CP_BORDER)
+        return get_border_context((combobox_theme_t *)theme, state_id);
+
+    return NULL;
+}
+
 uxgtk_theme_t *uxgtk_combobox_theme_create(void)
 {
     combobox_theme_t *theme;
+    GtkStyleContext *parent;
 
     TRACE("()\n");
 
@@ -210,21 +199,27 @@ uxgtk_theme_t *uxgtk_combobox_theme_create(void)
     uxgtk_theme_init(&theme->base, &combobox_vtable);
 
     /* I use a simple entry because .combobox-entry has no right border sometimes */
-    theme->entry = pgtk_entry_new();
-    theme->combobox = pgtk_combo_box_new_with_entry();
-
-    pgtk_container_add((GtkContainer *)theme->base.layout, theme->entry);
-    pgtk_container_add((GtkContainer *)theme->base.layout, theme->combobox);
-
-    /* Extract button */
-    pgtk_container_forall((GtkContainer *)theme->combobox, iter_callback, theme);
-
-    theme->arrow = pgtk_bin_get_child((GtkBin *)theme->button);
-
-    pgtk_widget_style_get(theme->combobox,
-                          "arrow-size", &theme->arrow_size,
-                          "arrow-scaling", &theme->arrow_scaling,
-                          NULL);
+    theme->entry = uxgtk_style_node_new(&theme->base, NULL, pgtk_entry_get_type(),
+                                        "entry", GTK_STYLE_CLASS_ENTRY);
+    theme->combobox = uxgtk_style_node_new(&theme->base, NULL, pgtk_combo_box_get_type(),
+                                           "combobox", GTK_STYLE_CLASS_COMBOBOX_ENTRY);
+
+    /* GTK 3.20 puts the entry and the button into a linked box */
+    parent = theme->combobox;
+    if (pgtk_widget_path_iter_set_object_name != NULL)
+        parent = uxgtk_style_node_new(&theme->base, parent, pgtk_box_get_type(),
+                                      "box", GTK_STYLE_CLASS_LINKED);
+
+    theme->button = uxgtk_style_node_new(&theme->base, parent, pgtk_toggle_button_get_type(),
+                                         "button", GTK_STYLE_CLASS_BUTTON);
+    theme->arrow = uxgtk_style_node_new(&theme->base, theme->button, pgtk_arrow_get_type(),
+                                        "arrow", NULL);
+
+    /* Style properties are looked up by the type of the path */
+    pgtk_style_context_get_style(theme->combobox,
+                                 "arrow-size", &theme->arrow_size,
+                                 "arrow-scaling", &theme->arrow_scaling,
+                                 NULL);
 
     /* A workaround for old themes like Ambiance */
     if (theme->arrow_scaling == 1)
@@ -0,0 +1,283 @@
+/*
+ * GTK uxtheme implementation
+ *
+ * Copyright (C) 2015 Ivan Akulinchev
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "uxthemegtk.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "winbase.h"
+#include "wingdi.h"
+
+#include "wine/debug.h"
+#include "wine/list.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(uxthemegtk);
+
+#define POOL_BUCKET_SIZE 64
+#define POOL_MAX_ENTRIES 8
+#define POOL_IDLE_TIMEOUT 5000 /* ms */
+#define POOL_MAX_WASTE 4 /* times the requested area */
+
+typedef struct _dib_pool
+{
+    struct list free_dibs;
+    int count; /* of free buffers */
+} dib_pool_t;
+
+static DWORD tls_index = TLS_OUT_OF_INDEXES;
+
+static int round_up(int size)
+{
+    return (size + POOL_BUCKET_SIZE - 1) / POOL_BUCKET_SIZE * POOL_BUCKET_SIZE;
+}
+
+static dib_pool_t *get_pool(void)
+{
+    dib_pool_t *pool;
+
+    if (tls_index == TLS_OUT_OF_INDEXES)
+        return NULL;
+
+    pool = TlsGetValue(tls_index);
+
+    if (pool == NULL)
+    {
+        pool = malloc(sizeof(dib_pool_t));
+        if (pool == NULL)
+            return NULL;
+
+        list_init(&pool->free_dibs);
+        pool->count = 0;
+
+        TlsSetValue(tls_index, pool);
+    }
+
+    return pool;
+}
+
+static uxgtk_dib_t *create_dib(int width, int height, int bpp, BOOL top_down)
+{
+    struct
+    {
+        BITMAPINFOHEADER header;
+        RGBQUAD colors[2]; /* for monochrome bitmaps */
+    } info;
+    uxgtk_dib_t *dib;
+
+    dib = malloc(sizeof(uxgtk_dib_t));
+    if (dib == NULL)
+        return NULL;
+
+    memset(&info, 0, sizeof(info));
+
+    info.header.biSize = sizeof(BITMAPINFOHEADER);
+    info.header.biWidth = width;
+    info.header.biHeight = top_down ? -height : height; /* see MSDN */
+    info.header.biPlanes = 1;
+    info.header.biBitCount = bpp;
+    info.header.biCompression = BI_RGB; /* no compression */
+    info.header.biSizeImage = 0;
+    info.header.biXPelsPerMeter = 1;
+    info.header.biYPelsPerMeter = 1;
+    info.header.biClrUsed = 0;
+    info.header.biClrImportant = 0;
+
+    /* Black and white */
+    info.colors[1].rgbBlue = info.colors[1].rgbGreen = info.colors[1].rgbRed = 0xff;
+
+    dib->hdc = CreateCompatibleDC(NULL);
+    dib->bitmap = CreateDIBSection(dib->hdc, (BITMAPINFO *)&info, DIB_RGB_COLORS,
+                                   (void **)&dib->bits, NULL, 0);
+
+    if (dib->hdc == NULL || dib->bitmap == NULL)
+    {
+        if (dib->bitmap != NULL)
+            DeleteObject(dib->bitmap);
+
+        if (dib->hdc != NULL)
+            DeleteDC(dib->hdc);
+
+        free(dib);
+        return NULL;
+    }
+
+    dib->old_bitmap = SelectObject(dib->hdc, dib->bitmap);
+    dib->width = width;
+    dib->height = height;
+    dib->stride = (width * bpp + 31) / 32 * 4; /* rows are DWORD aligned */
+    dib->bpp = bpp;
+    dib->top_down = top_down;
+    dib->last_used = 0;
+    dib->pool = NULL;
+
+    TRACE("Created a %dx%d %d bpp DIB section.\n", width, height, bpp);
+
+    return dib;
+}
+
+static void destroy_dib(uxgtk_dib_t *dib)
+{
+    SelectObject(dib->hdc, dib->old_bitmap);
+    DeleteObject(dib->bitmap);
+    DeleteDC(dib->hdc);
+    free(dib);
+}
+
+/* Frees buffers which were idle for too long, the oldest ones go first */
+static void trim_pool(dib_pool_t *pool, DWORD now)
+{
+    uxgtk_dib_t *dib;
+    struct list *cursor;
+
+    while ((cursor = list_tail(&pool->free_dibs)) != NULL)
+    {
+        dib = LIST_ENTRY(cursor, uxgtk_dib_t, entry);
+
+        if (now - dib->last_used < POOL_IDLE_TIMEOUT && pool->count <= POOL_MAX_ENTRIES)
+            break;
+
+        list_remove(&dib->entry);
+        destroy_dib(dib);
+        pool->count--;
+    }
+}
+
+/*
+ * Bottom-up buffers must have the exact height, otherwise the rows would be shifted.
+ * Buffers much larger than needed are left for larger requests.
+ */
+static BOOL dib_fits(const uxgtk_dib_t *dib, int width, int height, int bpp, BOOL top_down)
+{
+    if (dib->bpp != bpp || dib->top_down != top_down || dib->width < width)
+        return FALSE;
+
+    if (dib->width * dib->height > round_up(width) * round_up(height) * POOL_MAX_WASTE)
+        return FALSE;
+
+    return top_down ? dib->height >= height : dib->height == height;
+}
+
+/* Returns a memory DC with a DIB section of at least the given size and the given format */
+uxgtk_dib_t *uxgtk_dib_acquire_format(int width, int height, int bpp, BOOL top_down)
+{
+    uxgtk_dib_t *dib, *found = NULL;
+    dib_pool_t *pool = get_pool();
+
+    assert(width > 0 && height > 0);
+
+    if (pool == NULL)
+        return create_dib(width, height, bpp, top_down);
+
+    /* A thread which paints only now and then shouldn't sit on old buffers */
+    trim_pool(pool, GetTickCount());
+
+    /* Pick the smallest free buffer which is large enough */
+    LIST_FOR_EACH_ENTRY(dib, &pool->free_dibs, uxgtk_dib_t, entry)
+    {
+        if (!dib_fits(dib, width, height, bpp, top_down))
+            continue;
+
+        if (found == NULL || dib->width * dib->height < found->width * found->height)
+            found = dib;
+    }
+
+    if (found != NULL)
+    {
+        list_remove(&found->entry);
+        pool->count--;
+        return found;
+    }
+
+    dib = create_dib(round_up(width), top_down ? round_up(height) : height, bpp, top_down);
+
+    if (dib != NULL)
+        dib->pool = pool;
+
+    return dib;
+}
+
+/* Returns a memory DC with a top-down 32 bpp DIB section of at least the given size */
+uxgtk_dib_t *uxgtk_dib_acquire(int width, int height)
+{
+    return uxgtk_dib_acquire_format(width, height, 32, TRUE);
+}
+
+void uxgtk_dib_release(uxgtk_dib_t *dib)
+{
+    dib_pool_t *pool = get_pool();
+
+    if (dib == NULL)
+        return;
+
+    /* Pools aren't locked, so a buffer finished by another thread isn't reused */
+    if (pool == NULL || pool != dib->pool)
+    {
+        destroy_dib(dib);
+        return;
+    }
+
+    dib->last_used = GetTickCount();
+
+    /* Recently used buffers go first */
+    list_add_head(&pool->free_dibs, &dib->entry);
+    pool->count++;
+
+    trim_pool(pool, dib->last_used);
+}
+
+void uxgtk_dib_thread_detach(void)
+{
+    uxgtk_dib_t *dib, *next;
+    dib_pool_t *pool;
+
+    if (tls_index == TLS_OUT_OF_INDEXES)
+        return;
+
+    pool = TlsGetValue(tls_index);
+
+    if (pool == NULL)
+        return;
+
+    LIST_FOR_EACH_ENTRY_SAFE(dib, next, &pool->free_dibs, uxgtk_dib_t, entry)
+        destroy_dib(dib);
+
+    free(pool);
+
+    TlsSetValue(tls_index, NULL);
+}
+
+void uxgtk_dib_init(void)
+{
+    tls_index = TlsAlloc();
+
+    if (tls_index == TLS_OUT_OF_INDEXES)
+        WARN("No TLS index, DIB sections won't be reused.\n");
+}
+
+void uxgtk_dib_uninit(void)
+{
+    uxgtk_dib_thread_detach();
+
+    if (tls_index != TLS_OUT_OF_INDEXES)
+        TlsFree(tls_index);
+
+    tls_index = TLS_OUT_OF_INDEXES;
+}
@@ -43,12 +43,14 @@ static HRESULT get_color(uxgtk_theme_t *theme, int part_id, int state_id,
 static HRESULT draw_background(uxgtk_theme_t *theme, cairo_t *cr, int part_id, int state_id,
                                int width, int height);
 static BOOL is_part_defined(int part_id, int state_id);
+static GtkStyleContext *get_stretch_context(uxgtk_theme_t *theme, int part_id, int state_id);
 
 static const uxgtk_theme_vtable_t edit_vtable = {
     get_color,
     draw_background,
     NULL, /* get_part_size */
-    is_part_defined
+    is_part_defined,
+    get_stretch_context
 };
 
 static GtkStateFlags get_text_state_flags(int state_id)
@@ -89,7 +91,7 @@ static HRESULT get_fill_color(edit_theme_t *theme, int part_id, int state_id, Gd
     {
         case EP_EDITTEXT:
             state = get_text_state_flags(state_id);
-            context = pgtk_widget_get_style_context(theme->entry);
+            context = uxgtk_style_get(&theme->base, theme->entry, state, GTK_STYLE_CLASS_VIEW);
             break;
 
         default:
@@ -97,9 +99,7 @@ static HRESULT get_fill_color(edit_theme_t *theme, int part_id, int state_id, Gd
             return E_NOTIMPL;
     }
 
-    pgtk_style_context_add_class(context, GTK_STYLE_CLASS_VIEW);
     pgtk_style_context_get_background_color(context, state, rgba);
-    pgtk_style_context_remove_class(context, GTK_STYLE_CLASS_VIEW);
 
     return S_OK;
 }
@@ -146,24 +146,22 @@ static HRESULT get_color(uxgtk_theme_t *theme, int part_id, int state_id,
     return E_NOTIMPL;
 }
 
+static GtkStyleContext *get_text_context(edit_theme_t *theme, int state_id)
+{
+    return uxgtk_style_get(&theme->base, theme->entry, get_text_state_flags(state_id), NULL);
+}
+
 static HRESULT draw_text(edit_theme_t *theme, cairo_t *cr, int state_id, int width, int height)
 {
     GtkStyleContext *context;
-    GtkStateFlags state = get_text_state_flags(state_id);
 
     assert(theme != NULL);
 
-    context = pgtk_widget_get_style_context(theme->entry);
-
-    pgtk_style_context_save(context);
-
-    pgtk_style_context_set_state(context, state);
+    context = get_text_context(theme, state_id);
 
     pgtk_render_background(context, cr, 0, 0, width, height);
     pgtk_render_frame(context, cr, 0, 0, width, height);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
@@ -187,6 +185,14 @@ static BOOL is_part_defined(int part_id, int state_id)
     return (part_id == EP_EDITTEXT && state_id < ETS_ASSIST);
 }
 
+static GtkStyleContext *get_stretch_context(uxgtk_theme_t *theme, int part_id, int state_id)
+{
+    if (part_id == EP_EDITTEXT)
+        return get_text_context((edit_theme_t *)theme, state_id);
+
+    return NULL;
+}
+
 uxgtk_theme_t *uxgtk_edit_theme_create(void)
 {
     edit_theme_t *theme;
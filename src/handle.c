@@ -0,0 +1,514 @@
+/*
+ * GTK uxtheme implementation
+ *
+ * Copyright (C) 2015 Ivan Akulinchev
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * A theme handle is a slot index in the low word and the generation of the
+ * slot in the high word. Slots live in pages which never move, so a lookup
+ * is two array accesses and a comparison without any lock, and a handle
+ * which was already closed doesn't match the generation of its slot anymore.
+ * While an API call uses a handle, the slot counts it as a user, and closing
+ * the handle waits until the last user is gone before the theme is released.
+ *
+ * The themes of the windows are kept in a hash table instead of window
+ * properties. Destroyed windows are dropped when they are looked up or
+ * when the table fills up.
+ */
+
+#include "uxthemegtk.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "winbase.h"
+#include "winuser.h"
+#include "uxtheme.h"
+
+#include "wine/debug.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(uxthemegtk);
+
+#define PAGE_SHIFT 8
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define MAX_PAGES 256 /* so the index fits into the low word */
+#define NO_SLOT (-1)
+
+#define WINDOWS_INITIAL_SIZE 64
+
+struct handle_slot
+{
+    uxgtk_theme_t * volatile theme;
+    volatile DWORD value; /* the handle using the slot or 0 */
+    volatile LONG users; /* calls between uxgtk_handle_get and uxgtk_handle_put */
+    WORD generation;
+    int next_free;
+};
+
+struct handle_page
+{
+    struct handle_slot slots[PAGE_SIZE];
+};
+
+struct window_entry
+{
+    HWND hwnd;
+    HANDLE theme; /* what GetWindowTheme returns */
+    HANDLE texture; /* owned by the table, see EnableThemeDialogTexture */
+};
+
+static struct handle_page * volatile pages[MAX_PAGES];
+static int num_slots = 0;
+static int free_slots = NO_SLOT;
+
+static struct window_entry *windows = NULL;
+static unsigned int windows_size = 0; /* a power of two */
+static unsigned int windows_count = 0;
+
+static CRITICAL_SECTION handle_cs;
+static CRITICAL_SECTION_DEBUG handle_cs_debug =
+{
+    0, 0, &handle_cs,
+    { &handle_cs_debug.ProcessLocksList, &handle_cs_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": handle_cs") }
+};
+static CRITICAL_SECTION handle_cs = { &handle_cs_debug, -1, 0, 0, 0, 0 };
+
+static inline struct handle_slot *get_slot(int index)
+{
+    return &pages[index >> PAGE_SHIFT]->slots[index & (PAGE_SIZE - 1)];
+}
+
+/* Returns NULL if there are too many handles already */
+HANDLE uxgtk_handle_alloc(uxgtk_theme_t *theme)
+{
+    struct handle_page *page;
+    struct handle_slot *slot;
+    int index;
+    DWORD value;
+
+    assert(theme != NULL);
+
+    EnterCriticalSection(&handle_cs);
+
+    index = free_slots;
+
+    if (index != NO_SLOT)
+        free_slots = get_slot(index)->next_free;
+    else
+    {
+        if (num_slots == PAGE_SIZE * MAX_PAGES)
+        {
+            LeaveCriticalSection(&handle_cs);
+            ERR("Too many open theme handles.\n");
+            return NULL;
+        }
+
+        if (pages[num_slots >> PAGE_SHIFT] == NULL)
+        {
+            page = calloc(1, sizeof(*page));
+            if (page == NULL)
+            {
+                LeaveCriticalSection(&handle_cs);
+                return NULL;
+            }
+
+            pages[num_slots >> PAGE_SHIFT] = page;
+        }
+
+        index = num_slots++;
+    }
+
+    slot = get_slot(index);
+
+    if (++slot->generation == 0)
+        slot->generation = 1;
+
+    value = ((DWORD)slot->generation << 16) | (index + 1);
+
+    /* Readers check the value after taking the theme */
+    slot->theme = theme;
+    MemoryBarrier();
+    slot->value = value;
+
+    LeaveCriticalSection(&handle_cs);
+
+    return (HANDLE)(ULONG_PTR)value;
+}
+
+static struct handle_slot *find_slot(HANDLE handle)
+{
+    ULONG_PTR value = (ULONG_PTR)handle;
+    int index = (int)(value & 0xffff) - 1;
+
+    if (value > 0xffffffff || index < 0 || pages[index >> PAGE_SHIFT] == NULL)
+        return NULL;
+
+    return get_slot(index);
+}
+
+/*
+ * Returns NULL for invalid or closed handles, never takes a lock. Otherwise
+ * the theme stays valid until uxgtk_handle_put is called with the handle.
+ */
+uxgtk_theme_t *uxgtk_handle_get(HANDLE handle)
+{
+    struct handle_slot *slot = find_slot(handle);
+
+    if (slot == NULL || slot->value != (DWORD)(ULONG_PTR)handle)
+        return NULL;
+
+    /* A full barrier, the value is checked again after the user is visible */
+    InterlockedIncrement(&slot->users);
+
+    /* The handle might have been closed in the meantime */
+    if (slot->value != (DWORD)(ULONG_PTR)handle)
+    {
+        InterlockedDecrement(&slot->users);
+        return NULL;
+    }
+
+    return slot->theme;
+}
+
+/* Ends the use of a handle which uxgtk_handle_get succeeded for */
+void uxgtk_handle_put(HANDLE handle)
+{
+    struct handle_slot *slot = find_slot(handle);
+
+    assert(slot != NULL && slot->users > 0);
+
+    InterlockedDecrement(&slot->users);
+}
+
+/*
+ * Returns the theme of the handle, which the caller has to release, or NULL.
+ * Calls still using the handle are waited for, so the caller must not hold it.
+ */
+uxgtk_theme_t *uxgtk_handle_free(HANDLE handle)
+{
+    struct handle_slot *slot;
+    uxgtk_theme_t *theme = NULL;
+    int index = (int)((ULONG_PTR)handle & 0xffff) - 1;
+
+    EnterCriticalSection(&handle_cs);
+
+    slot = find_slot(handle);
+
+    if (slot != NULL && slot->value == (DWORD)(ULONG_PTR)handle)
+    {
+        slot->value = 0;
+        theme = slot->theme;
+    }
+
+    LeaveCriticalSection(&handle_cs);
+
+    if (theme == NULL)
+        return NULL;
+
+    /* New users see the cleared value, the current ones only draw a part */
+    MemoryBarrier();
+
+    while (slot->users != 0)
+        Sleep(0);
+
+    /* The slot can't be reused before it's on the free list */
+    EnterCriticalSection(&handle_cs);
+
+    slot->theme = NULL;
+    slot->next_free = free_slots;
+    free_slots = index;
+
+    LeaveCriticalSection(&handle_cs);
+
+    return theme;
+}
+
+static inline unsigned int hash_window(HWND hwnd)
+{
+    /* Window handles are multiples of 4 in a small range */
+    return ((ULONG_PTR)hwnd >> 2) * 2654435761u;
+}
+
+static struct window_entry *find_window(HWND hwnd)
+{
+    unsigned int i;
+
+    if (windows_size == 0)
+        return NULL;
+
+    for (i = hash_window(hwnd) & (windows_size - 1); windows[i].hwnd != NULL;
+         i = (i + 1) & (windows_size - 1))
+    {
+        if (windows[i].hwnd == hwnd)
+            return &windows[i];
+    }
+
+    return NULL;
+}
+
+/* Linear probing, so the following entries are moved back into the hole */
+static void remove_window(struct window_entry *entry)
+{
+    unsigned int mask = windows_size - 1, hole = entry - windows, i = hole, home;
+
+    windows_count--;
+
+    for (;;)
+    {
+        windows[hole].hwnd = NULL;
+
+        /* An entry stays if its home is cyclically in (hole, i] */
+        do
+        {
+            i = (i + 1) & mask;
+
+            if (windows[i].hwnd == NULL)
+                return;
+
+            home = hash_window(windows[i].hwnd) & mask;
+        }
+        while (hole <= i ? (hole < home && home <= i) : (hole < home || home <= i));
+
+        windows[hole] = windows[i];
+        hole = i;
+    }
+}
+
+static void insert_window(const struct window_entry *new_entry)
+{
+    unsigned int i;
+
+    for (i = hash_window(new_entry->hwnd) & (windows_size - 1); windows[i].hwnd != NULL;
+         i = (i + 1) & (windows_size - 1));
+
+    windows[i] = *new_entry;
+    windows_count++;
+}
+
+/*
+ * Drops the destroyed windows and grows the table if it's still too full.
+ * The textures of the dropped windows are returned to be closed outside.
+ */
+static BOOL make_room(HANDLE **textures, unsigned int *num_textures)
+{
+    struct window_entry *old = windows, *entry;
+    unsigned int i, old_size = windows_size, new_size;
+
+    *textures = NULL;
+    *num_textures = 0;
+
+    if ((windows_count + 1) * 4 < windows_size * 3)
+        return TRUE;
+
+    *textures = malloc(windows_count * sizeof(HANDLE));
+
+    /* Keep the entries if their textures couldn't be closed */
+    for (i = 0; i < windows_size && *textures != NULL; i++)
+    {
+        entry = &windows[i];
+
+        while (entry->hwnd != NULL && !IsWindow(entry->hwnd))
+        {
+            if (entry->texture != NULL)
+                (*textures)[(*num_textures)++] = entry->texture;
+
+            /* Moves the next entry here, so look at this one again */
+            remove_window(entry);
+        }
+    }
+
+    if ((windows_count + 1) * 2 < windows_size)
+        return TRUE;
+
+    new_size = windows_size ? windows_size * 2 : WINDOWS_INITIAL_SIZE;
+
+    windows = calloc(new_size, sizeof(*windows));
+    if (windows == NULL)
+    {
+        windows = old;
+        return (windows_count + 1) < windows_size;
+    }
+
+    windows_size = new_size;
+    windows_count = 0;
+
+    for (i = 0; i < old_size; i++)
+    {
+        if (old[i].hwnd != NULL)
+            insert_window(&old[i]);
+    }
+
+    free(old);
+
+    return TRUE;
+}
+
+static void close_textures(HANDLE *textures, unsigned int num_textures)
+{
+    unsigned int i;
+
+    for (i = 0; i < num_textures; i++)
+        CloseThemeData(textures[i]);
+
+    free(textures);
+}
+
+/*
+ * Like find_window, but drops the entry if the window is gone, so its handle
+ * doesn't inherit the theme. The texture is returned to be closed outside.
+ */
+static struct window_entry *find_live_window(HWND hwnd, HANDLE *dead_texture)
+{
+    struct window_entry *entry = find_window(hwnd);
+
+    *dead_texture = NULL;
+
+    if (entry == NULL || IsWindow(hwnd))
+        return entry;
+
+    *dead_texture = entry->texture;
+    remove_window(entry);
+
+    return NULL;
+}
+
+HANDLE uxgtk_window_get_theme(HWND hwnd)
+{
+    struct window_entry *entry;
+    HANDLE theme = NULL, dead_texture;
+
+    EnterCriticalSection(&handle_cs);
+
+    entry = find_live_window(hwnd, &dead_texture);
+    if (entry != NULL)
+        theme = entry->theme;
+
+    LeaveCriticalSection(&handle_cs);
+
+    if (dead_texture != NULL)
+        CloseThemeData(dead_texture);
+
+    return theme;
+}
+
+HANDLE uxgtk_window_get_texture(HWND hwnd)
+{
+    struct window_entry *entry;
+    HANDLE texture = NULL, dead_texture;
+
+    EnterCriticalSection(&handle_cs);
+
+    entry = find_live_window(hwnd, &dead_texture);
+    if (entry != NULL)
+        texture = entry->texture;
+
+    LeaveCriticalSection(&handle_cs);
+
+    if (dead_texture != NULL)
+        CloseThemeData(dead_texture);
+
+    return texture;
+}
+
+/*
+ * Associates the theme with the window. If the texture is not NULL, the
+ * table also takes it over and closes the previous one of the window.
+ */
+static void set_window(HWND hwnd, HANDLE theme, HANDLE texture)
+{
+    struct window_entry *entry, new_entry;
+    HANDLE *textures = NULL, old_texture = NULL, dead_texture;
+    unsigned int num_textures = 0;
+
+    if (hwnd == NULL)
+        return;
+
+    EnterCriticalSection(&handle_cs);
+
+    entry = find_live_window(hwnd, &dead_texture);
+
+    if (entry == NULL && make_room(&textures, &num_textures))
+    {
+        new_entry.hwnd = hwnd;
+        new_entry.theme = theme;
+        new_entry.texture = texture;
+
+        insert_window(&new_entry);
+        texture = NULL;
+    }
+    else if (entry != NULL)
+    {
+        entry->theme = theme;
+
+        if (texture != NULL)
+        {
+            old_texture = entry->texture;
+            entry->texture = texture;
+            texture = NULL;
+        }
+    }
+
+    LeaveCriticalSection(&handle_cs);
+
+    /* Closing goes to the render thread, so never under the lock */
+    if (num_textures > 0)
+        close_textures(textures, num_textures);
+    else
+        free(textures);
+
+    if (old_texture != NULL)
+        CloseThemeData(old_texture);
+
+    if (dead_texture != NULL)
+        CloseThemeData(dead_texture);
+
+    /* The table is full and cannot grow */
+    if (texture != NULL)
+        CloseThemeData(texture);
+}
+
+void uxgtk_window_set_theme(HWND hwnd, HANDLE theme)
+{
+    set_window(hwnd, theme, NULL);
+}
+
+void uxgtk_window_set_texture(HWND hwnd, HANDLE texture)
+{
+    set_window(hwnd, texture, texture);
+}
+
+/* Themes themselves go away with the host window, see uxtheme.c */
+void uxgtk_handle_uninit(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_PAGES; i++)
+    {
+        free(pages[i]);
+        pages[i] = NULL;
+    }
+
+    num_slots = 0;
+    free_slots = NO_SLOT;
+
+    free(windows);
+
+    windows = NULL;
+    windows_size = windows_count = 0;
+}
@@ -34,46 +34,53 @@ typedef struct _header_theme
 {
     uxgtk_theme_t base;
 
-    GtkWidget *treeview;
+    GtkStyleContext *treeview;
+    GtkStyleContext *button;
 } header_theme_t;
 
 static HRESULT draw_background(uxgtk_theme_t *theme, cairo_t *cr, int part_id, int state_id,
                                int width, int height);
 static BOOL is_part_defined(int part_id, int state_id);
+static GtkStyleContext *get_stretch_context(uxgtk_theme_t *theme, int part_id, int state_id);
 
 static const uxgtk_theme_vtable_t header_vtable = {
     NULL, /* get_color */
     draw_background,
     NULL, /* get_part_size */
-    is_part_defined
+    is_part_defined,
+    get_stretch_context
 };
 
-static HRESULT draw_item(header_theme_t *theme, cairo_t *cr, int state_id, int width, int height)
+static GtkStyleContext *get_item_context(header_theme_t *theme, int state_id)
 {
-    GtkWidget *widget;
-    GtkStyleContext *context;
-    GtkStateFlags state = GTK_STATE_FLAG_NORMAL;
+    uxgtk_style_desc_t desc;
 
-    assert(theme != NULL);
+    memset(&desc, 0, sizeof(desc));
 
-    widget = pgtk_tree_view_column_get_button(
-        pgtk_tree_view_get_column((GtkTreeView *)theme->treeview, 1));
-    context = pgtk_widget_get_style_context(widget);
+    desc.node = theme->button;
 
     if (state_id == HIS_HOT)
-        state = GTK_STATE_FLAG_PRELIGHT;
+        desc.state = GTK_STATE_FLAG_PRELIGHT;
     else if (state_id == HIS_PRESSED)
-        state = GTK_STATE_FLAG_ACTIVE;
+        desc.state = GTK_STATE_FLAG_ACTIVE;
+
+    /* A column in the middle, neither the first nor the last one */
+    desc.region = GTK_STYLE_REGION_COLUMN_HEADER;
+
+    return uxgtk_style_get_ex(&theme->base, &desc);
+}
+
+static HRESULT draw_item(header_theme_t *theme, cairo_t *cr, int state_id, int width, int height)
+{
+    GtkStyleContext *context;
 
-    pgtk_style_context_save(context);
+    assert(theme != NULL);
 
-    pgtk_style_context_set_state(context, state);
+    context = get_item_context(theme, state_id);
 
     pgtk_render_background(context, cr, 0, 0, width, height);
     pgtk_render_frame(context, cr, 0, 0, width, height);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
@@ -97,9 +104,18 @@ static BOOL is_part_defined(int part_id, int state_id)
     return (part_id == HP_HEADERITEM);
 }
 
+static GtkStyleContext *get_stretch_context(uxgtk_theme_t *theme, int part_id, int state_id)
+{
+    if (part_id == HP_HEADERITEM)
+        return get_item_context((header_theme_t *)theme, state_id);
+
+    return NULL;
+}
+
 uxgtk_theme_t *uxgtk_header_theme_create(void)
 {
     header_theme_t *theme;
+    GtkStyleContext *parent;
 
     TRACE("()\n");
 
@@ -108,13 +124,17 @@ uxgtk_theme_t *uxgtk_header_theme_create(void)
 
     uxgtk_theme_init(&theme->base, &header_vtable);
 
-    theme->treeview = pgtk_tree_view_new();
+    theme->treeview = uxgtk_style_node_new(&theme->base, NULL, pgtk_tree_view_get_type(),
+                                           "treeview", GTK_STYLE_CLASS_VIEW);
 
-    pgtk_tree_view_append_column((GtkTreeView *)theme->treeview, pgtk_tree_view_column_new());
-    pgtk_tree_view_append_column((GtkTreeView *)theme->treeview, pgtk_tree_view_column_new());
-    pgtk_tree_view_append_column((GtkTreeView *)theme->treeview, pgtk_tree_view_column_new());
+    /* GTK 3.20 has a header node between the view and the buttons */
+    parent = theme->treeview;
+    if (pgtk_widget_path_iter_set_object_name != NULL)
+        parent = uxgtk_style_node_new(&theme->base, parent, pgtk_tree_view_get_type(),
+                                      "header", NULL);
 
-    pgtk_container_add((GtkContainer *)theme->base.layout, theme->treeview);
+    theme->button = uxgtk_style_node_new(&theme->base, parent, pgtk_button_get_type(),
+                                         "button", GTK_STYLE_CLASS_BUTTON);
 
     return &theme->base;
 }
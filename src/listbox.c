@@ -40,32 +40,40 @@ typedef struct _listbox_theme
 static HRESULT draw_background(uxgtk_theme_t *theme, cairo_t *cr, int part_id, int state_id,
                                int width, int height);
 static BOOL is_part_defined(int part_id, int state_id);
+static GtkStyleContext *get_stretch_context(uxgtk_theme_t *theme, int part_id, int state_id);
 
 static const uxgtk_theme_vtable_t listbox_vtable = {
     NULL, /* get_color */
     draw_background,
     NULL, /* get_part_size */
-    is_part_defined
+    is_part_defined,
+    get_stretch_context
 };
 
+static GtkStyleContext *get_border_context(listbox_theme_t *theme)
+{
+    uxgtk_style_desc_t desc;
+
+    memset(&desc, 0, sizeof(desc));
+
+    desc.widget = theme->scrolled_window;
+    desc.classes[0] = GTK_STYLE_CLASS_VIEW;
+    desc.classes[1] = GTK_STYLE_CLASS_FRAME;
+
+    return uxgtk_style_get_ex(&theme->base, &desc);
+}
+
 static HRESULT draw_border(listbox_theme_t *theme, cairo_t *cr, int width, int height)
 {
     GtkStyleContext *context;
 
     assert(theme != NULL);
 
-    context = pgtk_widget_get_style_context(theme->scrolled_window);
-
-    pgtk_style_context_save(context);
-
-    pgtk_style_context_add_class(context, GTK_STYLE_CLASS_VIEW);
-    pgtk_style_context_add_class(context, GTK_STYLE_CLASS_FRAME);
+    context = get_border_context(theme);
 
     pgtk_render_background(context, cr, 0, 0, width, height);
     pgtk_render_frame(context, cr, 0, 0, width, height);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
@@ -93,6 +101,14 @@ static BOOL is_part_defined(int part_id, int state_id)
     return (part_id >= 0 && part_id < LBCP_ITEM);
 }
 
+static GtkStyleContext *get_stretch_context(uxgtk_theme_t *theme, int part_id, int state_id)
+{
+    if (part_id >= 0 && part_id < LBCP_ITEM)
+        return get_border_context((listbox_theme_t *)theme);
+
+    return NULL;
+}
+
 uxgtk_theme_t *uxgtk_listbox_theme_create(void)
 {
     listbox_theme_t *theme;
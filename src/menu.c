@@ -35,9 +35,9 @@ typedef struct _menu_theme
 {
     uxgtk_theme_t base;
 
-    GtkWidget *menubar;
-    GtkWidget *menuitem;
-    GtkWidget *menu;
+    GtkStyleContext *menubar;
+    GtkStyleContext *menuitem;
+    GtkStyleContext *menu;
 } menu_theme_t;
 
 static HRESULT get_color(uxgtk_theme_t *theme, int part_id, int state_id,
@@ -47,7 +47,8 @@ static const uxgtk_theme_vtable_t menu_vtable = {
     get_color,
     NULL, /* draw_background */
     NULL, /* get_part_size */
-    NULL /* is_part_defined */
+    NULL, /* is_part_defined */
+    NULL /* get_stretch_context */
 };
 
 static GtkStateFlags get_popup_item_state_flags(int state_id)
@@ -82,17 +83,17 @@ static HRESULT get_fill_color(menu_theme_t *theme, int part_id, int state_id, Gd
     {
         case MENU_BARBACKGROUND:
             state = GTK_STATE_FLAG_NORMAL;
-            context = pgtk_widget_get_style_context(theme->menubar);
+            context = theme->menubar;
             break;
 
         case MENU_POPUPBACKGROUND:
             state = GTK_STATE_FLAG_NORMAL;
-            context = pgtk_widget_get_style_context(theme->menu);
+            context = theme->menu;
             break;
 
         case MENU_POPUPITEM:
             state = get_popup_item_state_flags(state_id);
-            context = pgtk_widget_get_style_context(theme->menuitem);
+            context = uxgtk_style_get_node(&theme->base, theme->menuitem, state, NULL);
             break;
 
         default:
@@ -116,17 +117,17 @@ static HRESULT get_text_color(menu_theme_t *theme, int part_id, int state_id, Gd
     {
         case MENU_BARBACKGROUND:
             state = GTK_STATE_FLAG_NORMAL;
-            context = pgtk_widget_get_style_context(theme->menubar);
+            context = theme->menubar;
             break;
 
         case MENU_POPUPBACKGROUND:
             state = GTK_STATE_FLAG_NORMAL;
-            context = pgtk_widget_get_style_context(theme->menu);
+            context = theme->menu;
             break;
 
         case MENU_POPUPITEM:
             state = get_popup_item_state_flags(state_id);
-            context = pgtk_widget_get_style_context(theme->menuitem);
+            context = uxgtk_style_get_node(&theme->base, theme->menuitem, state, NULL);
             break;
 
         default:
@@ -168,13 +169,12 @@ uxgtk_theme_t *uxgtk_menu_theme_create(void)
 
     uxgtk_theme_init(&theme->base, &menu_vtable);
 
-    theme->menubar = pgtk_menu_bar_new();
-    theme->menuitem = pgtk_menu_item_new();
-    theme->menu = pgtk_menu_new();
-
-    pgtk_container_add((GtkContainer *)theme->base.layout, theme->menubar);
-    pgtk_menu_shell_append((GtkMenuShell *)theme->menubar, theme->menuitem);
-    pgtk_menu_item_set_submenu((GtkMenuItem *)theme->menuitem, theme->menu);
+    theme->menubar = uxgtk_style_node_new(&theme->base, NULL, pgtk_menu_bar_get_type(),
+                                          "menubar", GTK_STYLE_CLASS_MENUBAR);
+    theme->menuitem = uxgtk_style_node_new(&theme->base, theme->menubar, pgtk_menu_item_get_type(),
+                                           "menuitem", GTK_STYLE_CLASS_MENUITEM);
+    theme->menu = uxgtk_style_node_new(&theme->base, NULL, pgtk_menu_get_type(),
+                                       "menu", GTK_STYLE_CLASS_MENU);
 
     return &theme->base;
 }
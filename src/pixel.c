@@ -0,0 +1,445 @@
+/*
+ * GTK uxtheme implementation
+ *
+ * Copyright (C) 2015 Ivan Akulinchev
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "uxthemegtk.h"
+
+#include <stdlib.h>
+
+#include "winbase.h"
+
+#include "wine/debug.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+WINE_DEFAULT_DEBUG_CHANNEL(uxthemegtk);
+
+typedef BOOL (*opaque_func_t)(const unsigned char *bits, int stride, int width, int height);
+typedef void (*blend_func_t)(unsigned char *dst, int dst_stride,
+                             const unsigned char *src, int src_stride, int width, int height);
+
+/*
+ * Scalar kernels
+ */
+
+static BOOL opaque_scalar(const unsigned char *bits, int stride, int width, int height)
+{
+    int i, j;
+
+    for (i = 0; i < height; i++)
+    {
+        const unsigned int *row = (const unsigned int *)(bits + i * stride);
+        unsigned int alpha = 0xff000000;
+
+        for (j = 0; j < width; j++)
+            alpha &= row[j];
+
+        if (alpha != 0xff000000)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* x * a / 255 rounded, exact for all 8-bit values */
+static inline unsigned int mul_div_255(unsigned int x, unsigned int a)
+{
+    unsigned int t = x * a + 128;
+
+    return (t + (t >> 8)) >> 8;
+}
+
+static inline unsigned int blend_pixel(unsigned int src, unsigned int dst)
+{
+    int i;
+    unsigned int result = 0;
+    unsigned int inv_alpha = 255 - (src >> 24);
+
+    for (i = 0; i < 32; i += 8)
+    {
+        unsigned int channel = ((src >> i) & 0xff) + mul_div_255((dst >> i) & 0xff, inv_alpha);
+        result |= MIN(channel, 255) << i;
+    }
+
+    return result;
+}
+
+static void blend_scalar(unsigned char *dst, int dst_stride,
+                         const unsigned char *src, int src_stride, int width, int height)
+{
+    int i, j;
+
+    for (i = 0; i < height; i++)
+    {
+        const unsigned int *src_row = (const unsigned int *)(src + i * src_stride);
+        unsigned int *dst_row = (unsigned int *)(dst + i * dst_stride);
+
+        for (j = 0; j < width; j++)
+        {
+            unsigned int alpha = src_row[j] >> 24;
+
+            if (alpha == 0xff)
+                dst_row[j] = src_row[j];
+            else if (alpha != 0 || src_row[j] != 0)
+                dst_row[j] = blend_pixel(src_row[j], dst_row[j]);
+        }
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+
+/*
+ * SSE2 kernels
+ */
+
+static BOOL __attribute__((target("sse2")))
+opaque_sse2(const unsigned char *bits, int stride, int width, int height)
+{
+    int i, j;
+    const __m128i alpha_mask = _mm_set1_epi32(0xff000000);
+
+    for (i = 0; i < height; i++)
+    {
+        const unsigned int *row = (const unsigned int *)(bits + i * stride);
+        __m128i acc = _mm_set1_epi32(-1);
+
+        for (j = 0; j + 4 <= width; j += 4)
+            acc = _mm_and_si128(acc, _mm_loadu_si128((const __m128i *)(row + j)));
+
+        acc = _mm_and_si128(acc, alpha_mask);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(acc, alpha_mask)) != 0xffff)
+            return FALSE;
+
+        if (!opaque_scalar((const unsigned char *)(row + j), stride, width - j, 1))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Blends the low or high half of the unpacked pixels */
+static inline __m128i __attribute__((target("sse2")))
+blend_half_sse2(__m128i dst16, __m128i src16)
+{
+    const __m128i round = _mm_set1_epi16(128);
+    const __m128i max = _mm_set1_epi16(255);
+    __m128i alpha, t;
+
+    alpha = _mm_shufflelo_epi16(src16, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm_sub_epi16(max, alpha);
+
+    t = _mm_add_epi16(_mm_mullo_epi16(dst16, alpha), round);
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static void __attribute__((target("sse2")))
+blend_sse2(unsigned char *dst, int dst_stride,
+           const unsigned char *src, int src_stride, int width, int height)
+{
+    int i, j;
+    const __m128i zero = _mm_setzero_si128();
+
+    for (i = 0; i < height; i++)
+    {
+        const unsigned int *src_row = (const unsigned int *)(src + i * src_stride);
+        unsigned int *dst_row = (unsigned int *)(dst + i * dst_stride);
+
+        for (j = 0; j + 4 <= width; j += 4)
+        {
+            __m128i s = _mm_loadu_si128((const __m128i *)(src_row + j));
+            __m128i d = _mm_loadu_si128((const __m128i *)(dst_row + j));
+            __m128i lo, hi;
+
+            lo = blend_half_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+            hi = blend_half_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+
+            d = _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+            _mm_storeu_si128((__m128i *)(dst_row + j), d);
+        }
+
+        blend_scalar((unsigned char *)(dst_row + j), dst_stride,
+                     (const unsigned char *)(src_row + j), src_stride, width - j, 1);
+    }
+}
+
+/*
+ * AVX2 kernels
+ */
+
+static BOOL __attribute__((target("avx2")))
+opaque_avx2(const unsigned char *bits, int stride, int width, int height)
+{
+    int i, j;
+    const __m256i alpha_mask = _mm256_set1_epi32(0xff000000);
+
+    for (i = 0; i < height; i++)
+    {
+        const unsigned int *row = (const unsigned int *)(bits + i * stride);
+        __m256i acc = _mm256_set1_epi32(-1);
+
+        for (j = 0; j + 8 <= width; j += 8)
+            acc = _mm256_and_si256(acc, _mm256_loadu_si256((const __m256i *)(row + j)));
+
+        acc = _mm256_and_si256(acc, alpha_mask);
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(acc, alpha_mask)) != -1)
+            return FALSE;
+
+        if (!opaque_scalar((const unsigned char *)(row + j), stride, width - j, 1))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static inline __m256i __attribute__((target("avx2")))
+blend_half_avx2(__m256i dst16, __m256i src16)
+{
+    const __m256i round = _mm256_set1_epi16(128);
+    const __m256i max = _mm256_set1_epi16(255);
+    __m256i alpha, t;
+
+    alpha = _mm256_shufflelo_epi16(src16, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_sub_epi16(max, alpha);
+
+    t = _mm256_add_epi16(_mm256_mullo_epi16(dst16, alpha), round);
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+/* Unpacking and packing work within 128-bit lanes, so the pixel order is kept */
+static void __attribute__((target("avx2")))
+blend_avx2(unsigned char *dst, int dst_stride,
+           const unsigned char *src, int src_stride, int width, int height)
+{
+    int i, j;
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (i = 0; i < height; i++)
+    {
+        const unsigned int *src_row = (const unsigned int *)(src + i * src_stride);
+        unsigned int *dst_row = (unsigned int *)(dst + i * dst_stride);
+
+        for (j = 0; j + 8 <= width; j += 8)
+        {
+            __m256i s = _mm256_loadu_si256((const __m256i *)(src_row + j));
+            __m256i d = _mm256_loadu_si256((const __m256i *)(dst_row + j));
+            __m256i lo, hi;
+
+            lo = blend_half_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero));
+            hi = blend_half_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero));
+
+            d = _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi));
+            _mm256_storeu_si256((__m256i *)(dst_row + j), d);
+        }
+
+        blend_sse2((unsigned char *)(dst_row + j), dst_stride,
+                   (const unsigned char *)(src_row + j), src_stride, width - j, 1);
+    }
+}
+
+#endif /* HAVE_X86_KERNELS */
+
+static BOOL opaque_select(const unsigned char *bits, int stride, int width, int height);
+static void blend_select(unsigned char *dst, int dst_stride,
+                         const unsigned char *src, int src_stride, int width, int height);
+
+/* The kernels are picked on first use, not while the loader lock is held */
+static opaque_func_t opaque_func = opaque_select;
+static blend_func_t blend_func = blend_select;
+
+static INIT_ONCE kernels_init_once = INIT_ONCE_STATIC_INIT;
+
+/*
+ * Self-test
+ */
+
+#define TEST_WIDTH 37 /* not a multiple of the vector width on purpose */
+#define TEST_HEIGHT 3
+
+static unsigned int test_pixel(unsigned int *seed)
+{
+    unsigned int alpha, pixel;
+
+    *seed = *seed * 1103515245 + 12345;
+    pixel = *seed >> 8;
+    alpha = (*seed >> 4) & 0xff;
+
+    /* Premultiplied, so no channel exceeds the alpha */
+    pixel = (mul_div_255(pixel & 0xff, alpha)) |
+            (mul_div_255((pixel >> 8) & 0xff, alpha) << 8) |
+            (mul_div_255((pixel >> 16) & 0xff, alpha) << 16);
+
+    return pixel | (alpha << 24);
+}
+
+static BOOL test_kernels(const char *name, opaque_func_t opaque, blend_func_t blend)
+{
+    int i;
+    unsigned int seed = 0x1234;
+    unsigned int src[TEST_WIDTH * TEST_HEIGHT];
+    unsigned int dst[TEST_WIDTH * TEST_HEIGHT];
+    unsigned int expected[TEST_WIDTH * TEST_HEIGHT];
+    int stride = TEST_WIDTH * 4;
+
+    for (i = 0; i < TEST_WIDTH * TEST_HEIGHT; i++)
+    {
+        src[i] = test_pixel(&seed);
+        dst[i] = expected[i] = test_pixel(&seed);
+    }
+
+    /* Some special cases */
+    src[0] = 0;
+    src[1] = 0xffffffff;
+    src[2] = 0x80000000;
+
+    blend_scalar((unsigned char *)expected, stride, (const unsigned char *)src, stride,
+                 TEST_WIDTH, TEST_HEIGHT);
+    blend((unsigned char *)dst, stride, (const unsigned char *)src, stride,
+          TEST_WIDTH, TEST_HEIGHT);
+
+    if (memcmp(dst, expected, sizeof(dst)) != 0)
+    {
+        ERR("The %s blending kernel is broken.\n", name);
+        return FALSE;
+    }
+
+    for (i = 0; i < TEST_WIDTH * TEST_HEIGHT; i++)
+        src[i] |= 0xff000000;
+
+    if (!opaque((const unsigned char *)src, stride, TEST_WIDTH, TEST_HEIGHT))
+    {
+        ERR("The %s opacity kernel is broken.\n", name);
+        return FALSE;
+    }
+
+    /* The last pixel is handled by the scalar tail of the vector kernels */
+    for (i = 0; i < TEST_WIDTH * TEST_HEIGHT; i += 7)
+    {
+        src[i] &= 0xfeffffff;
+
+        if (opaque((const unsigned char *)src, stride, TEST_WIDTH, TEST_HEIGHT))
+        {
+            ERR("The %s opacity kernel is broken.\n", name);
+            return FALSE;
+        }
+
+        src[i] |= 0xff000000;
+    }
+
+    return TRUE;
+}
+
+/* Picks the fastest kernels supported by the CPU */
+static BOOL CALLBACK select_kernels_once(INIT_ONCE *once, void *param, void **context)
+{
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && test_kernels("AVX2", opaque_avx2, blend_avx2))
+    {
+        TRACE("Using AVX2 pixel kernels.\n");
+        opaque_func = opaque_avx2;
+        blend_func = blend_avx2;
+        return TRUE;
+    }
+
+    if (__builtin_cpu_supports("sse2") && test_kernels("SSE2", opaque_sse2, blend_sse2))
+    {
+        TRACE("Using SSE2 pixel kernels.\n");
+        opaque_func = opaque_sse2;
+        blend_func = blend_sse2;
+        return TRUE;
+    }
+#endif
+
+    TRACE("Using scalar pixel kernels.\n");
+    opaque_func = opaque_scalar;
+    blend_func = blend_scalar;
+
+    return TRUE;
+}
+
+static BOOL opaque_select(const unsigned char *bits, int stride, int width, int height)
+{
+    InitOnceExecuteOnce(&kernels_init_once, select_kernels_once, NULL, NULL);
+
+    return opaque_func(bits, stride, width, height);
+}
+
+static void blend_select(unsigned char *dst, int dst_stride,
+                         const unsigned char *src, int src_stride, int width, int height)
+{
+    InitOnceExecuteOnce(&kernels_init_once, select_kernels_once, NULL, NULL);
+
+    blend_func(dst, dst_stride, src, src_stride, width, height);
+}
+
+/* Checks whether all pixels of an ARGB32 buffer have the maximal alpha */
+BOOL uxgtk_pixels_opaque(const unsigned char *bits, int stride, int width, int height)
+{
+    return opaque_func(bits, stride, width, height);
+}
+
+/* Composites premultiplied ARGB32 pixels over the destination (source-over) */
+void uxgtk_pixels_blend(unsigned char *dst, int dst_stride,
+                        const unsigned char *src, int src_stride, int width, int height)
+{
+    blend_func(dst, dst_stride, src, src_stride, width, height);
+}
+
+/* Libc already has a vectorized memcpy, so just copy row by row */
+void uxgtk_pixels_copy(unsigned char *dst, int dst_stride,
+                       const unsigned char *src, int src_stride, int width, int height)
+{
+    int i;
+
+    if (dst_stride == src_stride && src_stride == width * 4)
+    {
+        memcpy(dst, src, (size_t)src_stride * height);
+        return;
+    }
+
+    for (i = 0; i < height; i++)
+        memcpy(dst + i * dst_stride, src + i * src_stride, width * 4);
+}
+
+/* Interpolates between two buffers, the weight of b is in 1/256 */
+void uxgtk_pixels_mix(unsigned char *dst, int dst_stride,
+                      const unsigned char *a, int a_stride,
+                      const unsigned char *b, int b_stride, int width, int height, int weight)
+{
+    int i, j;
+
+    /* A plain loop over bytes, so the compiler is able to vectorize it */
+    for (i = 0; i < height; i++)
+    {
+        const unsigned char *row_a = a + i * a_stride;
+        const unsigned char *row_b = b + i * b_stride;
+        unsigned char *row = dst + i * dst_stride;
+
+        for (j = 0; j < width * 4; j++)
+            row[j] = (row_a[j] * (256 - weight) + row_b[j] * weight) >> 8;
+    }
+}
@@ -45,7 +45,8 @@ static const uxgtk_theme_vtable_t rebar_vtable = {
     NULL, /* get_color */
     draw_background,
     NULL, /* get_part_size */
-    is_part_defined
+    is_part_defined,
+    NULL /* get_stretch_context */
 };
 
 static HRESULT draw_background(uxgtk_theme_t *theme, cairo_t *cr, int part_id, int state_id,
@@ -0,0 +1,287 @@
+/*
+ * GTK uxtheme implementation
+ *
+ * Copyright (C) 2015 Ivan Akulinchev
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * GTK is not thread-safe, so all GTK calls are made by a single render
+ * thread. Other threads push commands onto a lock-free stack and wait
+ * for their own event, the render thread takes the whole stack at once.
+ */
+
+#include "uxthemegtk.h"
+
+#include <assert.h>
+
+#include "winbase.h"
+
+#include "wine/debug.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(uxthemegtk);
+
+typedef struct _render_command
+{
+    struct _render_command *next;
+    uxgtk_render_proc_t proc;
+    void *data;
+    HANDLE done; /* the event of the waiting thread */
+} render_command_t;
+
+static render_command_t * volatile queue_head = NULL;
+static HANDLE queue_event = NULL;
+static HANDLE render_thread = NULL;
+static volatile DWORD render_thread_id = 0;
+static uxgtk_render_proc_t startup_proc = NULL;
+static uxgtk_idle_proc_t volatile idle_proc = NULL;
+static uxgtk_idle_proc_t volatile timer_proc = NULL;
+static volatile DWORD timer_delay = INFINITE;
+
+static DWORD tls_index = TLS_OUT_OF_INDEXES;
+
+/* Used when there is no render thread */
+static CRITICAL_SECTION render_cs;
+static CRITICAL_SECTION_DEBUG render_cs_debug =
+{
+    0, 0, &render_cs,
+    { &render_cs_debug.ProcessLocksList, &render_cs_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": render_cs") }
+};
+static CRITICAL_SECTION render_cs = { &render_cs_debug, -1, 0, 0, 0, 0 };
+
+static void push_command(render_command_t *command)
+{
+    render_command_t *head;
+
+    do
+    {
+        head = queue_head;
+        command->next = head;
+    }
+    while (InterlockedCompareExchangePointer((void **)&queue_head, command, head) != head);
+
+    SetEvent(queue_event);
+}
+
+/* Takes all pending commands in the submission order */
+static render_command_t *pop_commands(void)
+{
+    render_command_t *command, *next, *result = NULL;
+
+    command = InterlockedExchangePointer((void **)&queue_head, NULL);
+
+    while (command != NULL)
+    {
+        next = command->next;
+        command->next = result;
+        result = command;
+        command = next;
+    }
+
+    return result;
+}
+
+/* The module is pinned, so the thread simply runs until the process exits */
+static DWORD CALLBACK render_thread_proc(void *arg)
+{
+    render_command_t *command, *next;
+    DWORD timeout, elapsed, last_timer;
+
+    /* Set here, the startup procedure may already make render calls */
+    render_thread_id = GetCurrentThreadId();
+
+    TRACE("Render thread started.\n");
+
+    if (startup_proc != NULL)
+        startup_proc(NULL);
+
+    last_timer = GetTickCount();
+
+    for (;;)
+    {
+        elapsed = GetTickCount() - last_timer;
+
+        if (idle_proc != NULL)
+            timeout = 0;
+        else if (timer_proc != NULL)
+            timeout = elapsed < timer_delay ? timer_delay - elapsed : 0;
+        else
+            timeout = INFINITE;
+
+        WaitForSingleObject(queue_event, timeout);
+
+        for (command = pop_commands(); command != NULL; command = next)
+        {
+            /* The command lives on the stack of the waiting thread */
+            next = command->next;
+
+            command->proc(command->data);
+            SetEvent(command->done);
+        }
+
+        /* Background work only runs while nobody is waiting */
+        if (idle_proc != NULL && queue_head == NULL)
+        {
+            if (!idle_proc())
+                idle_proc = NULL;
+        }
+
+        /* Steady render calls must not hold the timer back */
+        if (timer_proc != NULL && GetTickCount() - last_timer >= timer_delay)
+        {
+            last_timer = GetTickCount();
+
+            if (!timer_proc())
+                timer_proc = NULL;
+        }
+    }
+
+    return 0;
+}
+
+static HANDLE get_thread_event(void)
+{
+    HANDLE event;
+
+    if (tls_index == TLS_OUT_OF_INDEXES)
+        return NULL;
+
+    event = TlsGetValue(tls_index);
+
+    if (event == NULL)
+    {
+        event = CreateEventW(NULL, FALSE, FALSE, NULL);
+        TlsSetValue(tls_index, event);
+    }
+
+    return event;
+}
+
+/* Runs the procedure on the render thread and waits until it's done */
+void uxgtk_render_call(uxgtk_render_proc_t proc, void *data)
+{
+    render_command_t command;
+
+    if (GetCurrentThreadId() == render_thread_id)
+    {
+        proc(data);
+        return;
+    }
+
+    command.done = get_thread_event();
+
+    if (render_thread == NULL || command.done == NULL)
+    {
+        /* Still better than calling GTK from several threads at once */
+        EnterCriticalSection(&render_cs);
+        proc(data);
+        LeaveCriticalSection(&render_cs);
+        return;
+    }
+
+    command.proc = proc;
+    command.data = data;
+
+    push_command(&command);
+
+    WaitForSingleObject(command.done, INFINITE);
+}
+
+/*
+ * Sets the procedure the render thread calls in small steps whenever the
+ * queue is empty, until it returns FALSE.
+ */
+void uxgtk_render_set_idle(uxgtk_idle_proc_t proc)
+{
+    idle_proc = proc;
+
+    if (queue_event != NULL)
+        SetEvent(queue_event);
+}
+
+/*
+ * Sets the procedure the render thread calls every time the delay has passed,
+ * between the commands, until it returns FALSE.
+ */
+void uxgtk_render_set_timer(uxgtk_idle_proc_t proc, DWORD delay)
+{
+    timer_delay = delay;
+    timer_proc = proc;
+
+    if (queue_event != NULL)
+        SetEvent(queue_event);
+}
+
+void uxgtk_render_thread_detach(void)
+{
+    HANDLE event;
+
+    if (tls_index == TLS_OUT_OF_INDEXES)
+        return;
+
+    event = TlsGetValue(tls_index);
+
+    if (event != NULL)
+    {
+        CloseHandle(event);
+        TlsSetValue(tls_index, NULL);
+    }
+}
+
+/* The startup procedure is the first thing the render thread does */
+void uxgtk_render_init(uxgtk_render_proc_t startup)
+{
+    assert(render_thread == NULL);
+
+    startup_proc = startup;
+
+    tls_index = TlsAlloc();
+    queue_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    if (tls_index != TLS_OUT_OF_INDEXES && queue_event != NULL)
+        render_thread = CreateThread(NULL, 0, render_thread_proc, NULL, 0, NULL);
+
+    if (render_thread == NULL)
+    {
+        WARN("No render thread, GTK calls will be serialized.\n");
+
+        if (startup != NULL)
+            startup(NULL);
+    }
+}
+
+/*
+ * The caller pins the module before the render thread is started, so this
+ * only runs when the process exits and the thread is already gone.
+ */
+void uxgtk_render_uninit(void)
+{
+    uxgtk_render_thread_detach();
+
+    if (render_thread != NULL)
+        CloseHandle(render_thread);
+
+    if (queue_event != NULL)
+        CloseHandle(queue_event);
+
+    if (tls_index != TLS_OUT_OF_INDEXES)
+        TlsFree(tls_index);
+
+    render_thread = queue_event = NULL;
+    render_thread_id = 0;
+    tls_index = TLS_OUT_OF_INDEXES;
+}
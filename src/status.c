@@ -48,7 +48,8 @@ static const uxgtk_theme_vtable_t status_vtable = {
     NULL, /* get_color */
     draw_background,
     get_part_size,
-    is_part_defined
+    is_part_defined,
+    NULL /* get_stretch_context */
 };
 
 static HRESULT draw_pane(uxgtk_theme_t *theme, cairo_t *cr, int width, int height)
@@ -57,9 +58,9 @@ static HRESULT draw_pane(uxgtk_theme_t *theme, cairo_t *cr, int width, int heigh
 
     assert(theme != NULL);
 
-    context = pgtk_widget_get_style_context(theme->window);
+    context = uxgtk_style_get(theme, theme->window, GTK_STATE_FLAG_NORMAL,
+                              GTK_STYLE_CLASS_BACKGROUND);
 
-    pgtk_style_context_add_class(context, GTK_STYLE_CLASS_BACKGROUND);
     pgtk_render_background(context, cr, 0, 0, width, height);
 
     return S_OK;
@@ -67,21 +68,21 @@ static HRESULT draw_pane(uxgtk_theme_t *theme, cairo_t *cr, int width, int heigh
 
 static HRESULT draw_gripper(uxgtk_theme_t *theme, cairo_t *cr, int width, int height)
 {
+    uxgtk_style_desc_t desc;
     GtkStyleContext *context;
 
     assert(theme != NULL);
 
-    context = pgtk_widget_get_style_context(theme->window);
+    memset(&desc, 0, sizeof(desc));
 
-    pgtk_style_context_save(context);
+    desc.widget = theme->window;
+    desc.classes[0] = GTK_STYLE_CLASS_GRIP;
+    desc.junction_sides = GTK_JUNCTION_CORNER_BOTTOMRIGHT;
 
-    pgtk_style_context_add_class(context, GTK_STYLE_CLASS_GRIP);
-    pgtk_style_context_set_junction_sides(context, GTK_JUNCTION_CORNER_BOTTOMRIGHT);
+    context = uxgtk_style_get_ex(theme, &desc);
 
     pgtk_render_handle(context, cr, 0, 0, width, height);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
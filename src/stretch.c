@@ -0,0 +1,166 @@
+/*
+ * GTK uxtheme implementation
+ *
+ * Copyright (C) 2015 Ivan Akulinchev
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "uxthemegtk.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "wine/debug.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(uxthemegtk);
+
+typedef struct _sample
+{
+    int src0;
+    int src1;
+    int weight; /* weight of src1 in 1/256 */
+} sample_t;
+
+/*
+ * Borders are copied as they are, the center is linearly interpolated.
+ * Only the destination pixels from start to end are mapped.
+ */
+static void build_map(sample_t *map, int start, int end, int dst_len, int src_len, int border)
+{
+    int i, max_pos;
+    LONGLONG pos;
+    int src_center = src_len - 2 * border;
+    int dst_center = dst_len - 2 * border;
+
+    max_pos = (src_center - 1) * 256;
+
+    for (i = start; i < end; i++, map++)
+    {
+        if (i < border)
+        {
+            map->src0 = map->src1 = i;
+            map->weight = 0;
+        }
+        else if (i >= dst_len - border)
+        {
+            map->src0 = map->src1 = i - dst_len + src_len;
+            map->weight = 0;
+        }
+        else
+        {
+            /* Sample at pixel centers: (i + 0.5) * src / dst - 0.5 */
+            pos = (2 * (LONGLONG)(i - border) + 1) * src_center * 128 / dst_center - 128;
+            pos = CLAMP(pos, 0, max_pos);
+
+            map->src0 = border + (int)(pos >> 8);
+            map->src1 = MIN(map->src0 + 1, border + src_center - 1);
+            map->weight = (int)(pos & 0xff);
+        }
+    }
+}
+
+static inline unsigned int lerp_pixel(unsigned int a, unsigned int b, int weight)
+{
+    unsigned int rb, ag;
+
+    rb = ((a & 0xff00ff) * (256 - weight) + (b & 0xff00ff) * weight) >> 8;
+    ag = ((a >> 8) & 0xff00ff) * (256 - weight) + ((b >> 8) & 0xff00ff) * weight;
+
+    return (rb & 0xff00ff) | (ag & 0xff00ff00);
+}
+
+static void stretch_row(const unsigned int *src, unsigned int *dst, const sample_t *map, int width)
+{
+    int i;
+
+    for (i = 0; i < width; i++)
+    {
+        if (map[i].weight == 0)
+            dst[i] = src[map[i].src0];
+        else
+            dst[i] = lerp_pixel(src[map[i].src0], src[map[i].src1], map[i].weight);
+    }
+}
+
+/* A plain loop over bytes, so the compiler is able to vectorize it */
+static void blend_rows(const unsigned char *a, const unsigned char *b, unsigned char *dst,
+                       int weight, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i++)
+        dst[i] = (a[i] * (256 - weight) + b[i] * weight) >> 8;
+}
+
+/*
+ * Scales the source to width x height, keeping the border untouched. Only the
+ * area is produced, its top left pixel goes to the start of dst.
+ */
+BOOL uxgtk_stretch_nine_slice(const uxgtk_bitmap_t *src, int border, int width, int height,
+                              const RECT *area, unsigned char *dst, int dst_stride)
+{
+    int i, row_size;
+    int area_width = area->right - area->left;
+    int area_height = area->bottom - area->top;
+    sample_t *columns, *rows;
+    unsigned char *stretched;
+
+    assert(src != NULL && dst != NULL);
+
+    if (width <= 2 * border || height <= 2 * border ||
+        src->width <= 2 * border || src->height <= 2 * border)
+        return FALSE;
+
+    row_size = area_width * 4;
+
+    columns = malloc(area_width * sizeof(sample_t));
+    rows = malloc(area_height * sizeof(sample_t));
+    stretched = malloc(row_size * src->height);
+
+    if (columns == NULL || rows == NULL || stretched == NULL)
+    {
+        free(columns);
+        free(rows);
+        free(stretched);
+        return FALSE;
+    }
+
+    build_map(columns, area->left, area->right, width, src->width, border);
+    build_map(rows, area->top, area->bottom, height, src->height, border);
+
+    /* Horizontal pass over every source row */
+    for (i = 0; i < src->height; i++)
+        stretch_row((const unsigned int *)(src->data + i * src->stride),
+                    (unsigned int *)(stretched + i * row_size), columns, area_width);
+
+    /* Vertical pass */
+    for (i = 0; i < area_height; i++)
+    {
+        const unsigned char *row0 = stretched + rows[i].src0 * row_size;
+        const unsigned char *row1 = stretched + rows[i].src1 * row_size;
+
+        if (rows[i].weight == 0)
+            memcpy(dst + i * dst_stride, row0, row_size);
+        else
+            blend_rows(row0, row1, dst + i * dst_stride, rows[i].weight, row_size);
+    }
+
+    free(columns);
+    free(rows);
+    free(stretched);
+
+    return TRUE;
+}
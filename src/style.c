@@ -0,0 +1,267 @@
+/*
+ * GTK uxtheme implementation
+ *
+ * Copyright (C) 2015 Ivan Akulinchev
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * Changing the state or the classes of a style context makes GTK compute
+ * the CSS cascade again, so every save/set_state/restore around a draw
+ * costs a full lookup. Instead each theme keeps standalone style contexts
+ * with the state and the classes fixed, built once from the widget path.
+ *
+ * Most parts don't need a real widget at all: a node is a standalone
+ * context for a widget path built by hand, like "treeview button", and
+ * gets the same per-state contexts as a widget.
+ */
+
+#include "uxthemegtk.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "wine/debug.h"
+#include "wine/list.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(uxthemegtk);
+
+#define MAX_STYLE_CLASSES (sizeof(((uxgtk_style_desc_t *)0)->classes) / sizeof(const char *))
+
+struct style_entry
+{
+    struct list entry;
+    uxgtk_style_desc_t desc;
+    GtkStyleContext *context;
+};
+
+static BOOL equal_strings(const char *a, const char *b)
+{
+    if (a == b)
+        return TRUE;
+
+    return (a != NULL && b != NULL && strcmp(a, b) == 0);
+}
+
+static BOOL equal_descs(const uxgtk_style_desc_t *a, const uxgtk_style_desc_t *b)
+{
+    int i;
+
+    if (a->widget != b->widget || a->node != b->node || a->state != b->state ||
+        a->region_flags != b->region_flags || a->junction_sides != b->junction_sides ||
+        !equal_strings(a->region, b->region))
+        return FALSE;
+
+    for (i = 0; i < MAX_STYLE_CLASSES; i++)
+    {
+        if (!equal_strings(a->classes[i], b->classes[i]))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static GtkStyleContext *create_context(const uxgtk_style_desc_t *desc)
+{
+    int i;
+    GtkWidget *parent_widget;
+    GtkWidgetPath *path;
+    GtkStyleContext *context, *parent = NULL;
+
+    if (desc->widget != NULL)
+    {
+        path = pgtk_widget_path_copy(pgtk_widget_get_path(desc->widget));
+
+        /* Inherited properties like the color come from the parent */
+        parent_widget = pgtk_widget_get_parent(desc->widget);
+
+        if (parent_widget != NULL)
+            parent = pgtk_widget_get_style_context(parent_widget);
+    }
+    else
+    {
+        path = pgtk_widget_path_copy(pgtk_style_context_get_path(desc->node));
+        parent = pgtk_style_context_get_parent(desc->node);
+    }
+
+    for (i = 0; i < MAX_STYLE_CLASSES && desc->classes[i] != NULL; i++)
+        pgtk_widget_path_iter_add_class(path, -1, desc->classes[i]);
+
+    if (desc->region != NULL)
+        pgtk_widget_path_iter_add_region(path, -1, desc->region, desc->region_flags);
+
+    context = pgtk_style_context_new();
+
+    pgtk_style_context_set_path(context, path);
+    pgtk_widget_path_free(path);
+
+    if (parent != NULL)
+        pgtk_style_context_set_parent(context, parent);
+
+    pgtk_style_context_set_state(context, desc->state);
+
+    if (desc->junction_sides != GTK_JUNCTION_NONE)
+        pgtk_style_context_set_junction_sides(context, desc->junction_sides);
+
+    return context;
+}
+
+/* Runs on the render thread */
+GtkStyleContext *uxgtk_style_get_ex(uxgtk_theme_t *theme, const uxgtk_style_desc_t *desc)
+{
+    struct style_entry *entry;
+
+    assert(theme != NULL);
+    assert(desc->widget != NULL || desc->node != NULL);
+
+    LIST_FOR_EACH_ENTRY(entry, &theme->styles, struct style_entry, entry)
+    {
+        if (equal_descs(&entry->desc, desc))
+            return entry->context;
+    }
+
+    entry = malloc(sizeof(*entry));
+    if (entry == NULL)
+        return desc->widget != NULL ? pgtk_widget_get_style_context(desc->widget) : desc->node;
+
+    entry->desc = *desc;
+    entry->context = create_context(desc);
+
+    list_add_head(&theme->styles, &entry->entry);
+
+    return entry->context;
+}
+
+/* The common case of a widget in some state with at most one extra class */
+GtkStyleContext *uxgtk_style_get(uxgtk_theme_t *theme, GtkWidget *widget, GtkStateFlags state,
+                                 const char *style_class)
+{
+    uxgtk_style_desc_t desc;
+
+    memset(&desc, 0, sizeof(desc));
+
+    desc.widget = widget;
+    desc.state = state;
+    desc.classes[0] = style_class;
+
+    return uxgtk_style_get_ex(theme, &desc);
+}
+
+GtkStyleContext *uxgtk_style_get_node(uxgtk_theme_t *theme, GtkStyleContext *node,
+                                      GtkStateFlags state, const char *style_class)
+{
+    uxgtk_style_desc_t desc;
+
+    memset(&desc, 0, sizeof(desc));
+
+    desc.node = node;
+    desc.state = state;
+    desc.classes[0] = style_class;
+
+    return uxgtk_style_get_ex(theme, &desc);
+}
+
+/*
+ * Creates a node of the given type below the parent node, or below the
+ * theme layout if there is no parent. The name is the CSS node name used
+ * since GTK 3.20, older versions match the type and the class instead.
+ * Nodes live as long as the theme.
+ */
+GtkStyleContext *uxgtk_style_node_new(uxgtk_theme_t *theme, GtkStyleContext *parent, GType type,
+                                      const char *name, const char *style_class)
+{
+    struct style_entry *entry;
+    GtkWidgetPath *path;
+
+    assert(theme != NULL);
+
+    if (parent != NULL)
+        path = pgtk_widget_path_copy(pgtk_style_context_get_path(parent));
+    else
+    {
+        path = pgtk_widget_path_copy(pgtk_widget_get_path(theme->layout));
+        parent = pgtk_widget_get_style_context(theme->layout);
+    }
+
+    pgtk_widget_path_append_type(path, type);
+
+    /* Optional, see load_gtk3_libs */
+    if (pgtk_widget_path_iter_set_object_name != NULL)
+        pgtk_widget_path_iter_set_object_name(path, -1, name);
+
+    if (style_class != NULL)
+        pgtk_widget_path_iter_add_class(path, -1, style_class);
+
+    entry = malloc(sizeof(*entry));
+    if (entry == NULL)
+    {
+        pgtk_widget_path_free(path);
+        return NULL;
+    }
+
+    memset(&entry->desc, 0, sizeof(entry->desc));
+
+    entry->context = pgtk_style_context_new();
+
+    pgtk_style_context_set_path(entry->context, path);
+    pgtk_style_context_set_parent(entry->context, parent);
+    pgtk_widget_path_free(path);
+
+    list_add_tail(&theme->nodes, &entry->entry);
+
+    return entry->context;
+}
+
+/*
+ * Returns how far the frame of the context reaches in from the edges: the
+ * widest border plus the corner radius. The context has a fixed state.
+ */
+int uxgtk_style_get_slice_inset(GtkStyleContext *context)
+{
+    GtkBorder border;
+    GtkStateFlags state = pgtk_style_context_get_state(context);
+    int radius = 0;
+
+    pgtk_style_context_get_border(context, state, &border);
+    pgtk_style_context_get(context, state, GTK_STYLE_PROPERTY_BORDER_RADIUS, &radius, NULL);
+
+    return MAX(MAX(border.left, border.right), MAX(border.top, border.bottom)) + radius;
+}
+
+static void free_entries(struct list *entries)
+{
+    struct style_entry *entry, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE(entry, next, entries, struct style_entry, entry)
+    {
+        list_remove(&entry->entry);
+
+        pg_object_unref(entry->context);
+        free(entry);
+    }
+}
+
+/* Drops the per-state contexts, they are created again on demand */
+void uxgtk_style_flush(uxgtk_theme_t *theme)
+{
+    free_entries(&theme->styles);
+}
+
+void uxgtk_style_free(uxgtk_theme_t *theme)
+{
+    free_entries(&theme->styles);
+    free_entries(&theme->nodes);
+}
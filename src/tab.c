@@ -42,26 +42,29 @@ typedef struct _tab_theme
 static HRESULT draw_background(uxgtk_theme_t *theme, cairo_t *cr, int part_id, int state_id,
                                int width, int height);
 static BOOL is_part_defined(int part_id, int state_id);
+static GtkStyleContext *get_stretch_context(uxgtk_theme_t *theme, int part_id, int state_id);
 
 static const uxgtk_theme_vtable_t tab_vtable = {
     NULL, /* get_color */
     draw_background,
     NULL, /* get_part_size */
-    is_part_defined
+    is_part_defined,
+    get_stretch_context
 };
 
 static HRESULT draw_tab_item(tab_theme_t *theme, cairo_t *cr, int part_id, int state_id,
                              int width, int height)
 {
     int x = 0, new_width = width, new_height = height;
-    GtkRegionFlags region = 0;
+    uxgtk_style_desc_t desc;
     GtkStyleContext *context;
 
     assert(theme != NULL);
 
-    context = pgtk_widget_get_style_context(theme->notebook);
+    memset(&desc, 0, sizeof(desc));
 
-    pgtk_style_context_save(context);
+    desc.widget = theme->notebook;
+    desc.region = GTK_STYLE_REGION_TAB;
 
     /* Emulate the "-GtkNotebook-tab-overlap" style property */
     if (part_id == TABP_TABITEM || part_id == TABP_TABITEMRIGHTEDGE)
@@ -72,48 +75,53 @@ static HRESULT draw_tab_item(tab_theme_t *theme, cairo_t *cr, int part_id, int s
 
     /* Provide GTK a little bit more information about the tab position */
     if (part_id == TABP_TABITEMLEFTEDGE || part_id == TABP_TOPTABITEMLEFTEDGE)
-        region = GTK_REGION_FIRST;
+        desc.region_flags = GTK_REGION_FIRST;
     else if (part_id == TABP_TABITEMRIGHTEDGE || part_id == TABP_TOPTABITEMRIGHTEDGE)
-        region = GTK_REGION_LAST;
+        desc.region_flags = GTK_REGION_LAST;
     else if (part_id == TABP_TABITEMBOTHEDGE || part_id == TABP_TOPTABITEMBOTHEDGE)
-        region = GTK_REGION_ONLY;
-    pgtk_style_context_add_region(context, GTK_STYLE_REGION_TAB, region);
+        desc.region_flags = GTK_REGION_ONLY;
 
     /* Some themes are not friendly with the TCS_MULTILINE tabs */
-    pgtk_style_context_set_junction_sides(context, GTK_JUNCTION_BOTTOM);
+    desc.junction_sides = GTK_JUNCTION_BOTTOM;
 
     /* Active tabs have their own parts */
     if (part_id > TABP_TABITEMBOTHEDGE && part_id < TABP_PANE) {
         new_height--; /* Fix the active tab height */
-        pgtk_style_context_set_state(context, GTK_STATE_FLAG_ACTIVE);
+        desc.state = GTK_STATE_FLAG_ACTIVE;
     }
 
+    context = uxgtk_style_get_ex(&theme->base, &desc);
+
     pgtk_render_background(context, cr, x, 0, new_width, new_height);
     pgtk_render_frame(context, cr, x, 0, new_width, new_height);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
+static GtkStyleContext *get_pane_context(tab_theme_t *theme)
+{
+    uxgtk_style_desc_t desc;
+
+    memset(&desc, 0, sizeof(desc));
+
+    desc.widget = theme->notebook;
+    desc.classes[0] = GTK_STYLE_CLASS_FRAME;
+    desc.junction_sides = GTK_JUNCTION_TOP;
+
+    return uxgtk_style_get_ex(&theme->base, &desc);
+}
+
 static HRESULT draw_tab_pane(tab_theme_t *theme, cairo_t *cr, int width, int height)
 {
     GtkStyleContext *context;
 
     assert(theme != NULL);
 
-    context = pgtk_widget_get_style_context(theme->notebook);
-
-    pgtk_style_context_save(context);
-
-    pgtk_style_context_add_class(context, GTK_STYLE_CLASS_FRAME);
-    pgtk_style_context_set_junction_sides(context, GTK_JUNCTION_TOP);
+    context = get_pane_context(theme);
 
     pgtk_render_background(context, cr, 0, 0, width, height);
     pgtk_render_frame(context, cr, 0, 0, width, height);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
@@ -172,6 +180,14 @@ static BOOL is_part_defined(int part_id, int state_id)
     return (part_id > 0 && part_id <= TABP_AEROWIZARDBODY);
 }
 
+static GtkStyleContext *get_stretch_context(uxgtk_theme_t *theme, int part_id, int state_id)
+{
+    if (part_id == TABP_PANE)
+        return get_pane_context((tab_theme_t *)theme);
+
+    return NULL;
+}
+
 uxgtk_theme_t *uxgtk_tab_theme_create(void)
 {
     tab_theme_t *theme;
@@ -46,7 +46,8 @@ static const uxgtk_theme_vtable_t toolbar_vtable = {
     NULL, /* get_color */
     draw_background,
     NULL, /* get_part_size */
-    is_part_defined
+    is_part_defined,
+    NULL /* get_stretch_context */
 };
 
 static GtkStateFlags get_state_flags(int state_id)
@@ -77,17 +78,11 @@ static HRESULT draw_button(toolbar_theme_t *theme, cairo_t *cr, int state_id, in
 
     assert(theme != NULL);
 
-    context = pgtk_widget_get_style_context(theme->button);
-
-    pgtk_style_context_save(context);
-
-    pgtk_style_context_set_state(context, state);
+    context = uxgtk_style_get(&theme->base, theme->button, state, NULL);
 
     pgtk_render_background(context, cr, 0, 0, width, height);
     pgtk_render_frame(context, cr, 0, 0, width, height);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
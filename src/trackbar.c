@@ -48,7 +48,8 @@ static const uxgtk_theme_vtable_t trackbar_vtable = {
     NULL, /* get_color */
     draw_background,
     NULL, /* get_part_size */
-    is_part_defined
+    is_part_defined,
+    NULL /* get_stretch_context */
 };
 
 static HRESULT draw_track(trackbar_theme_t *theme, cairo_t *cr, int part_id, int width, int height)
@@ -58,10 +59,6 @@ static HRESULT draw_track(trackbar_theme_t *theme, cairo_t *cr, int part_id, int
 
     assert(theme != NULL);
 
-    context = pgtk_widget_get_style_context(theme->scale);
-
-    pgtk_style_context_save(context);
-
     if (part_id == TKP_TRACKVERT)
     {
         y1 = 0;
@@ -75,47 +72,46 @@ static HRESULT draw_track(trackbar_theme_t *theme, cairo_t *cr, int part_id, int
         y1 = y2 = height/2;
     }
 
-    pgtk_style_context_add_class(context, GTK_STYLE_CLASS_SEPARATOR);
+    context = uxgtk_style_get(&theme->base, theme->scale, GTK_STATE_FLAG_NORMAL,
+                              GTK_STYLE_CLASS_SEPARATOR);
 
     pgtk_render_line(context, cr, x1, y1, x2, y2);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
 static HRESULT draw_thumb(trackbar_theme_t *theme, cairo_t *cr, int state_id, int width, int height)
 {
-    GtkStyleContext *context = pgtk_widget_get_style_context(theme->scale);
-    GtkStateFlags state = GTK_STATE_FLAG_NORMAL;
+    uxgtk_style_desc_t desc;
+    GtkStyleContext *context;
 
-    pgtk_style_context_save(context);
+    memset(&desc, 0, sizeof(desc));
+
+    desc.widget = theme->scale;
 
     if (state_id == TUS_HOT)
-        state = GTK_STATE_FLAG_PRELIGHT;
+        desc.state = GTK_STATE_FLAG_PRELIGHT;
     else if (state_id == TUBS_PRESSED)
-        state = GTK_STATE_FLAG_ACTIVE;
-
-    pgtk_style_context_set_state(context, state);
+        desc.state = GTK_STATE_FLAG_ACTIVE;
 
     if (width > height)
         if (theme->slider_length > theme->slider_width)
-            pgtk_style_context_add_class(context, GTK_STYLE_CLASS_HORIZONTAL);
+            desc.classes[0] = GTK_STYLE_CLASS_HORIZONTAL;
         else
-            pgtk_style_context_add_class(context, GTK_STYLE_CLASS_VERTICAL);
+            desc.classes[0] = GTK_STYLE_CLASS_VERTICAL;
     else
         if (theme->slider_length > theme->slider_width)
-            pgtk_style_context_add_class(context, GTK_STYLE_CLASS_VERTICAL);
+            desc.classes[0] = GTK_STYLE_CLASS_VERTICAL;
         else
-            pgtk_style_context_add_class(context, GTK_STYLE_CLASS_HORIZONTAL);
+            desc.classes[0] = GTK_STYLE_CLASS_HORIZONTAL;
 
-    pgtk_style_context_add_class(context, GTK_STYLE_CLASS_SLIDER);
+    desc.classes[1] = GTK_STYLE_CLASS_SLIDER;
+
+    context = uxgtk_style_get_ex(&theme->base, &desc);
 
     pgtk_render_slider(context, cr, 0, 0, theme->slider_length, theme->slider_width,
                       GTK_ORIENTATION_HORIZONTAL);
 
-    pgtk_style_context_restore(context);
-
     return S_OK;
 }
 
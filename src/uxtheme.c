@@ -38,30 +38,160 @@
 #include "wine/library.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(uxthemegtk);
+WINE_DECLARE_DEBUG_CHANNEL(uxstartup);
 
 static void *libgtk3 = NULL;
 static void *libcairo = NULL;
 static void *libgobject2 = NULL;
 
+static INIT_ONCE gtk_init_once = INIT_ONCE_STATIC_INIT;
+static INIT_ONCE fake_theme_init_once = INIT_ONCE_STATIC_INIT;
+
+typedef struct _symbol
+{
+    const char *name;
+    void **ptr;
+} symbol_t;
+
+#define SYMBOL(f) { #f, (void **)&p##f }
+
+/* Widget constructors and types of each class, resolved when the class is first opened */
+static const symbol_t button_symbols[] = {
+    SYMBOL(gtk_button_new),
+    SYMBOL(gtk_check_button_new),
+    SYMBOL(gtk_frame_new),
+    SYMBOL(gtk_label_new),
+    SYMBOL(gtk_radio_button_new),
+    { NULL, NULL }
+};
+
+static const symbol_t combobox_symbols[] = {
+    SYMBOL(gtk_arrow_get_type),
+    SYMBOL(gtk_box_get_type),
+    SYMBOL(gtk_combo_box_get_type),
+    SYMBOL(gtk_entry_get_type),
+    SYMBOL(gtk_toggle_button_get_type),
+    { NULL, NULL }
+};
+
+static const symbol_t edit_symbols[] = {
+    SYMBOL(gtk_entry_new),
+    { NULL, NULL }
+};
+
+static const symbol_t header_symbols[] = {
+    SYMBOL(gtk_button_get_type),
+    SYMBOL(gtk_tree_view_get_type),
+    { NULL, NULL }
+};
+
+static const symbol_t listbox_symbols[] = {
+    SYMBOL(gtk_scrolled_window_new),
+    { NULL, NULL }
+};
+
+static const symbol_t menu_symbols[] = {
+    SYMBOL(gtk_menu_bar_get_type),
+    SYMBOL(gtk_menu_get_type),
+    SYMBOL(gtk_menu_item_get_type),
+    { NULL, NULL }
+};
+
+static const symbol_t rebar_symbols[] = {
+    SYMBOL(gtk_toolbar_new),
+    { NULL, NULL }
+};
+
+static const symbol_t tab_symbols[] = {
+    SYMBOL(gtk_notebook_new),
+    { NULL, NULL }
+};
+
+static const symbol_t toolbar_symbols[] = {
+    SYMBOL(gtk_button_new),
+    SYMBOL(gtk_separator_tool_item_new),
+    { NULL, NULL }
+};
+
+static const symbol_t trackbar_symbols[] = {
+    SYMBOL(gtk_scale_new),
+    { NULL, NULL }
+};
+
+#undef SYMBOL
+
 static const struct {
     const WCHAR *classname;
     uxgtk_theme_t *(*create)(void);
+    const symbol_t *symbols;
 } classes[] = {
-    { VSCLASS_BUTTON,   uxgtk_button_theme_create },
-    { VSCLASS_COMBOBOX, uxgtk_combobox_theme_create },
-    { VSCLASS_EDIT,     uxgtk_edit_theme_create },
-    { VSCLASS_HEADER,   uxgtk_header_theme_create },
-    { VSCLASS_LISTBOX,  uxgtk_listbox_theme_create },
-    { VSCLASS_LISTVIEW, uxgtk_listview_theme_create },
-    { VSCLASS_MENU,     uxgtk_menu_theme_create },
-    { VSCLASS_REBAR,    uxgtk_rebar_theme_create },
-    { VSCLASS_STATUS,   uxgtk_status_theme_create },
-    { VSCLASS_TAB,      uxgtk_tab_theme_create },
-    { VSCLASS_TOOLBAR,  uxgtk_toolbar_theme_create },
-    { VSCLASS_TRACKBAR, uxgtk_trackbar_theme_create },
-    { VSCLASS_WINDOW,   uxgtk_window_theme_create }
+    { VSCLASS_BUTTON,   uxgtk_button_theme_create,   button_symbols },
+    { VSCLASS_COMBOBOX, uxgtk_combobox_theme_create, combobox_symbols },
+    { VSCLASS_EDIT,     uxgtk_edit_theme_create,     edit_symbols },
+    { VSCLASS_HEADER,   uxgtk_header_theme_create,   header_symbols },
+    { VSCLASS_LISTBOX,  uxgtk_listbox_theme_create,  listbox_symbols },
+    { VSCLASS_LISTVIEW, uxgtk_listview_theme_create, listbox_symbols },
+    { VSCLASS_MENU,     uxgtk_menu_theme_create,     menu_symbols },
+    { VSCLASS_REBAR,    uxgtk_rebar_theme_create,    rebar_symbols },
+    { VSCLASS_STATUS,   uxgtk_status_theme_create,   NULL },
+    { VSCLASS_TAB,      uxgtk_tab_theme_create,      tab_symbols },
+    { VSCLASS_TOOLBAR,  uxgtk_toolbar_theme_create,  toolbar_symbols },
+    { VSCLASS_TRACKBAR, uxgtk_trackbar_theme_create, trackbar_symbols },
+    { VSCLASS_WINDOW,   uxgtk_window_theme_create,   NULL }
+};
+
+#define NUM_CLASSES (sizeof(classes) / sizeof(classes[0]))
+
+/* Only touched by the render thread */
+static BOOL classes_loaded[NUM_CLASSES];
+
+/* The toplevel of all theme widgets, only touched by the render thread */
+static GtkWidget *host_window = NULL;
+static GtkWidget *host_layout = NULL;
+
+/* Every control of a class draws the same, so they all share one instance */
+static uxgtk_theme_t *shared_themes[NUM_CLASSES]; /* only touched by the render thread */
+
+/* Themes without handles are parked for a while before the teardown */
+static DWORD parked_since[NUM_CLASSES]; /* only touched by the render thread */
+
+/* Live handles of each class, see handle.c for the handles themselves */
+static LONG open_handles[NUM_CLASSES];
+
+/* Open addressing table of the class names, holds class index + 1 */
+#define CLASS_INDEX_SIZE 64
+static unsigned char class_index[CLASS_INDEX_SIZE];
+
+/* Parts drawn by almost every application, at their usual sizes */
+static const struct {
+    const WCHAR *classname;
+    int part_id;
+    int state_id;
+    int width;
+    int height;
+} prewarm_parts[] = {
+    { VSCLASS_BUTTON,   BP_PUSHBUTTON,     PBS_NORMAL,          75, 23 },
+    { VSCLASS_BUTTON,   BP_PUSHBUTTON,     PBS_HOT,             75, 23 },
+    { VSCLASS_BUTTON,   BP_PUSHBUTTON,     PBS_PRESSED,         75, 23 },
+    { VSCLASS_BUTTON,   BP_PUSHBUTTON,     PBS_DEFAULTED,       75, 23 },
+    { VSCLASS_BUTTON,   BP_CHECKBOX,       CBS_UNCHECKEDNORMAL, 13, 13 },
+    { VSCLASS_BUTTON,   BP_CHECKBOX,       CBS_CHECKEDNORMAL,   13, 13 },
+    { VSCLASS_BUTTON,   BP_RADIOBUTTON,    RBS_UNCHECKEDNORMAL, 13, 13 },
+    { VSCLASS_BUTTON,   BP_RADIOBUTTON,    RBS_CHECKEDNORMAL,   13, 13 },
+    { VSCLASS_COMBOBOX, CP_DROPDOWNBUTTON, CBXS_NORMAL,         17, 21 },
+    { VSCLASS_EDIT,     EP_EDITTEXT,       ETS_NORMAL,          100, 21 },
+    { VSCLASS_HEADER,   HP_HEADERITEM,     HIS_NORMAL,          100, 24 },
+    { VSCLASS_TAB,      TABP_TABITEM,      TIS_NORMAL,          60, 21 },
+    { VSCLASS_TAB,      TABP_TABITEM,      TIS_SELECTED,        60, 21 },
+    { VSCLASS_TOOLBAR,  TP_BUTTON,         TS_HOT,              24, 22 },
+    { VSCLASS_TOOLBAR,  TP_BUTTON,         TS_PRESSED,          24, 22 },
+    { VSCLASS_TRACKBAR, TKP_THUMB,         TUS_NORMAL,          11, 21 }
 };
 
+/* References to the shared themes taken in the background, they keep the GTK styles warm */
+static uxgtk_theme_t *prototypes[NUM_CLASSES];
+static unsigned int prewarm_position = 0;
+
 #ifndef SONAME_LIBGTK_3
 #define SONAME_LIBGTK_3 "libgtk-3.so"
 #endif
@@ -78,28 +208,35 @@ static const struct {
 MAKE_FUNCPTR(cairo_create);
 MAKE_FUNCPTR(cairo_destroy);
 MAKE_FUNCPTR(cairo_image_surface_create);
+MAKE_FUNCPTR(cairo_image_surface_create_for_data);
 MAKE_FUNCPTR(cairo_image_surface_get_data);
 MAKE_FUNCPTR(cairo_image_surface_get_stride);
 MAKE_FUNCPTR(cairo_surface_destroy);
 MAKE_FUNCPTR(cairo_surface_flush);
-MAKE_FUNCPTR(g_type_check_instance_is_a);
-MAKE_FUNCPTR(gtk_bin_get_child);
+MAKE_FUNCPTR(cairo_translate);
+MAKE_FUNCPTR(g_object_get);
+MAKE_FUNCPTR(g_object_unref);
+MAKE_FUNCPTR(g_signal_connect_data);
+MAKE_FUNCPTR(gtk_arrow_get_type);
+MAKE_FUNCPTR(gtk_box_get_type);
+MAKE_FUNCPTR(gtk_button_get_type);
 MAKE_FUNCPTR(gtk_button_new);
 MAKE_FUNCPTR(gtk_check_button_new);
-MAKE_FUNCPTR(gtk_combo_box_new_with_entry);
+MAKE_FUNCPTR(gtk_combo_box_get_type);
 MAKE_FUNCPTR(gtk_container_add);
-MAKE_FUNCPTR(gtk_container_forall);
+MAKE_FUNCPTR(gtk_events_pending);
+MAKE_FUNCPTR(gtk_entry_get_type);
 MAKE_FUNCPTR(gtk_entry_new);
 MAKE_FUNCPTR(gtk_fixed_new);
 MAKE_FUNCPTR(gtk_frame_new);
 MAKE_FUNCPTR(gtk_init);
 MAKE_FUNCPTR(gtk_label_new);
-MAKE_FUNCPTR(gtk_menu_bar_new);
-MAKE_FUNCPTR(gtk_menu_item_new);
-MAKE_FUNCPTR(gtk_menu_item_set_submenu);
-MAKE_FUNCPTR(gtk_menu_new);
-MAKE_FUNCPTR(gtk_menu_shell_append);
+MAKE_FUNCPTR(gtk_main_iteration_do);
+MAKE_FUNCPTR(gtk_menu_bar_get_type);
+MAKE_FUNCPTR(gtk_menu_get_type);
+MAKE_FUNCPTR(gtk_menu_item_get_type);
 MAKE_FUNCPTR(gtk_notebook_new);
+MAKE_FUNCPTR(gtk_offscreen_window_new);
 MAKE_FUNCPTR(gtk_radio_button_new);
 MAKE_FUNCPTR(gtk_render_arrow);
 MAKE_FUNCPTR(gtk_render_background);
@@ -112,53 +249,107 @@ MAKE_FUNCPTR(gtk_render_slider);
 MAKE_FUNCPTR(gtk_scale_new);
 MAKE_FUNCPTR(gtk_scrolled_window_new);
 MAKE_FUNCPTR(gtk_separator_tool_item_new);
+MAKE_FUNCPTR(gtk_settings_get_default);
 MAKE_FUNCPTR(gtk_style_context_add_class);
-MAKE_FUNCPTR(gtk_style_context_add_region);
+MAKE_FUNCPTR(gtk_style_context_get);
 MAKE_FUNCPTR(gtk_style_context_get_background_color);
+MAKE_FUNCPTR(gtk_style_context_get_border);
 MAKE_FUNCPTR(gtk_style_context_get_border_color);
 MAKE_FUNCPTR(gtk_style_context_get_color);
+MAKE_FUNCPTR(gtk_style_context_get_parent);
+MAKE_FUNCPTR(gtk_style_context_get_path);
+MAKE_FUNCPTR(gtk_style_context_get_state);
 MAKE_FUNCPTR(gtk_style_context_get_style);
-MAKE_FUNCPTR(gtk_style_context_remove_class);
-MAKE_FUNCPTR(gtk_style_context_restore);
-MAKE_FUNCPTR(gtk_style_context_save);
+MAKE_FUNCPTR(gtk_style_context_new);
 MAKE_FUNCPTR(gtk_style_context_set_junction_sides);
+MAKE_FUNCPTR(gtk_style_context_set_parent);
+MAKE_FUNCPTR(gtk_style_context_set_path);
 MAKE_FUNCPTR(gtk_style_context_set_state);
 MAKE_FUNCPTR(gtk_toggle_button_get_type);
 MAKE_FUNCPTR(gtk_toolbar_new);
-MAKE_FUNCPTR(gtk_tree_view_append_column);
-MAKE_FUNCPTR(gtk_tree_view_column_get_button);
-MAKE_FUNCPTR(gtk_tree_view_column_new);
-MAKE_FUNCPTR(gtk_tree_view_get_column);
-MAKE_FUNCPTR(gtk_tree_view_new);
+MAKE_FUNCPTR(gtk_tree_view_get_type);
 MAKE_FUNCPTR(gtk_widget_destroy);
+MAKE_FUNCPTR(gtk_widget_get_parent);
+MAKE_FUNCPTR(gtk_widget_get_path);
 MAKE_FUNCPTR(gtk_widget_get_style_context);
+MAKE_FUNCPTR(gtk_widget_path_append_type);
+MAKE_FUNCPTR(gtk_widget_path_copy);
+MAKE_FUNCPTR(gtk_widget_path_free);
+MAKE_FUNCPTR(gtk_widget_path_iter_add_class);
+MAKE_FUNCPTR(gtk_widget_path_iter_add_region);
+MAKE_FUNCPTR(gtk_widget_path_iter_set_object_name);
 MAKE_FUNCPTR(gtk_widget_style_get);
-MAKE_FUNCPTR(gtk_window_new);
 #undef MAKE_FUNCPTR
 
 #define NUM_SYS_COLORS (COLOR_MENUBAR + 1)
 #define MENU_HEIGHT 20
-#define CLASSLIST_MAXLEN 128
+
+/* Stretchable parts are rendered once at this size and then scaled */
+#define SLICE_CANONICAL_SIZE 48
+
+#define TRANSITION_DURATION 200 /* ms, approximated, see GetThemeTransitionDuration */
+
+/* A batch covering more than this times the area of its parts is drawn part by part */
+#define BATCH_MAX_SPARSENESS 4
+
+#define PARK_DURATION 5000 /* ms without any handle before a theme is destroyed */
+#define TIMER_PERIOD 1000 /* ms, see timer_step */
 
 static WCHAR fake_msstyles_file[MAX_PATH];
+static BY_HANDLE_FILE_INFORMATION fake_msstyles_info;
+static BOOL fake_msstyles_info_valid = FALSE;
 
-static const WCHAR THEME_PROPERTY[] = {'u','x','g','t','k','_','t','h','e','m','e',0};
 static const WCHAR FAKE_NAME[] = {'G','T','K',0};
 static const WCHAR FAKE_COLOR[] = {'N','o','r','m','a','l','C','o','l','o','r',0};
 static const WCHAR FAKE_SIZE[] = {'N','o','r','m','a','l','S','i','z','e',0};
 
-static void apply_colors(void)
+/* Immutable once published, replaced as a whole when the GTK theme changes */
+typedef struct _sys_colors
 {
-    int i, colors[NUM_SYS_COLORS];
-    COLORREF refs[NUM_SYS_COLORS];
+    struct _sys_colors *retired_next;
+    COLORREF colors[NUM_SYS_COLORS];
+} sys_colors_t;
 
-    for (i = 0; i < NUM_SYS_COLORS; i++)
-    {
-        refs[i] = GetThemeSysColor(NULL, i);
-        colors[i] = i;
-    }
+static sys_colors_t * volatile sys_colors = NULL;
+static sys_colors_t * volatile applied_sys_colors = NULL; /* passed to SetSysColors */
+static sys_colors_t *retired_sys_colors = NULL; /* only touched by the render thread */
+
+static void publish_colors(void);
+static void queue_apply_colors(void);
+
+/*
+ * Startup phases are timed only with WINEDEBUG=+uxstartup, every phase
+ * prints one "phase=<name> [class=<name>] us=<microseconds>" line.
+ */
+static LONGLONG begin_phase(void)
+{
+    LARGE_INTEGER counter;
+
+    if (!TRACE_ON(uxstartup))
+        return 0;
+
+    QueryPerformanceCounter(&counter);
+
+    return counter.QuadPart;
+}
+
+static void end_phase(const char *phase, const WCHAR *classname, LONGLONG start)
+{
+    LARGE_INTEGER counter, frequency;
+    unsigned int elapsed;
+
+    if (start == 0)
+        return;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
 
-    SetSysColors(NUM_SYS_COLORS, colors, refs);
+    elapsed = (unsigned int)((counter.QuadPart - start) * 1000000 / frequency.QuadPart);
+
+    if (classname != NULL)
+        TRACE_(uxstartup)("phase=%s class=%s us=%u\n", phase, debugstr_w(classname), elapsed);
+    else
+        TRACE_(uxstartup)("phase=%s us=%u\n", phase, elapsed);
 }
 
 static void fix_sys_params(void)
@@ -210,24 +401,12 @@ static BOOL load_gtk3_libs(void)
         goto error;
     }
 
-    LOAD_FUNCPTR(libgtk3, gtk_bin_get_child)
-    LOAD_FUNCPTR(libgtk3, gtk_button_new)
-    LOAD_FUNCPTR(libgtk3, gtk_check_button_new)
-    LOAD_FUNCPTR(libgtk3, gtk_combo_box_new_with_entry)
     LOAD_FUNCPTR(libgtk3, gtk_container_add)
-    LOAD_FUNCPTR(libgtk3, gtk_container_forall)
-    LOAD_FUNCPTR(libgtk3, gtk_entry_new)
+    LOAD_FUNCPTR(libgtk3, gtk_events_pending)
     LOAD_FUNCPTR(libgtk3, gtk_fixed_new)
-    LOAD_FUNCPTR(libgtk3, gtk_frame_new)
     LOAD_FUNCPTR(libgtk3, gtk_init)
-    LOAD_FUNCPTR(libgtk3, gtk_label_new)
-    LOAD_FUNCPTR(libgtk3, gtk_menu_bar_new)
-    LOAD_FUNCPTR(libgtk3, gtk_menu_item_new)
-    LOAD_FUNCPTR(libgtk3, gtk_menu_item_set_submenu)
-    LOAD_FUNCPTR(libgtk3, gtk_menu_new)
-    LOAD_FUNCPTR(libgtk3, gtk_menu_shell_append)
-    LOAD_FUNCPTR(libgtk3, gtk_notebook_new)
-    LOAD_FUNCPTR(libgtk3, gtk_radio_button_new)
+    LOAD_FUNCPTR(libgtk3, gtk_main_iteration_do)
+    LOAD_FUNCPTR(libgtk3, gtk_offscreen_window_new)
     LOAD_FUNCPTR(libgtk3, gtk_render_arrow)
     LOAD_FUNCPTR(libgtk3, gtk_render_background)
     LOAD_FUNCPTR(libgtk3, gtk_render_check)
@@ -236,31 +415,36 @@ static BOOL load_gtk3_libs(void)
     LOAD_FUNCPTR(libgtk3, gtk_render_line)
     LOAD_FUNCPTR(libgtk3, gtk_render_option)
     LOAD_FUNCPTR(libgtk3, gtk_render_slider)
-    LOAD_FUNCPTR(libgtk3, gtk_scale_new)
-    LOAD_FUNCPTR(libgtk3, gtk_scrolled_window_new)
-    LOAD_FUNCPTR(libgtk3, gtk_separator_tool_item_new)
+    LOAD_FUNCPTR(libgtk3, gtk_settings_get_default)
     LOAD_FUNCPTR(libgtk3, gtk_style_context_add_class)
-    LOAD_FUNCPTR(libgtk3, gtk_style_context_add_region)
+    LOAD_FUNCPTR(libgtk3, gtk_style_context_get)
     LOAD_FUNCPTR(libgtk3, gtk_style_context_get_background_color)
+    LOAD_FUNCPTR(libgtk3, gtk_style_context_get_border)
     LOAD_FUNCPTR(libgtk3, gtk_style_context_get_border_color)
     LOAD_FUNCPTR(libgtk3, gtk_style_context_get_color)
+    LOAD_FUNCPTR(libgtk3, gtk_style_context_get_parent)
+    LOAD_FUNCPTR(libgtk3, gtk_style_context_get_path)
+    LOAD_FUNCPTR(libgtk3, gtk_style_context_get_state)
     LOAD_FUNCPTR(libgtk3, gtk_style_context_get_style)
-    LOAD_FUNCPTR(libgtk3, gtk_style_context_remove_class)
-    LOAD_FUNCPTR(libgtk3, gtk_style_context_restore)
-    LOAD_FUNCPTR(libgtk3, gtk_style_context_save)
+    LOAD_FUNCPTR(libgtk3, gtk_style_context_new)
     LOAD_FUNCPTR(libgtk3, gtk_style_context_set_junction_sides)
+    LOAD_FUNCPTR(libgtk3, gtk_style_context_set_parent)
+    LOAD_FUNCPTR(libgtk3, gtk_style_context_set_path)
     LOAD_FUNCPTR(libgtk3, gtk_style_context_set_state)
-    LOAD_FUNCPTR(libgtk3, gtk_toggle_button_get_type)
-    LOAD_FUNCPTR(libgtk3, gtk_toolbar_new)
-    LOAD_FUNCPTR(libgtk3, gtk_tree_view_append_column)
-    LOAD_FUNCPTR(libgtk3, gtk_tree_view_column_get_button)
-    LOAD_FUNCPTR(libgtk3, gtk_tree_view_column_new)
-    LOAD_FUNCPTR(libgtk3, gtk_tree_view_get_column)
-    LOAD_FUNCPTR(libgtk3, gtk_tree_view_new)
     LOAD_FUNCPTR(libgtk3, gtk_widget_destroy)
+    LOAD_FUNCPTR(libgtk3, gtk_widget_get_parent)
+    LOAD_FUNCPTR(libgtk3, gtk_widget_get_path)
     LOAD_FUNCPTR(libgtk3, gtk_widget_get_style_context)
+    LOAD_FUNCPTR(libgtk3, gtk_widget_path_append_type)
+    LOAD_FUNCPTR(libgtk3, gtk_widget_path_copy)
+    LOAD_FUNCPTR(libgtk3, gtk_widget_path_free)
+    LOAD_FUNCPTR(libgtk3, gtk_widget_path_iter_add_class)
+    LOAD_FUNCPTR(libgtk3, gtk_widget_path_iter_add_region)
     LOAD_FUNCPTR(libgtk3, gtk_widget_style_get)
-    LOAD_FUNCPTR(libgtk3, gtk_window_new)
+
+    /* CSS node names appeared in GTK 3.20 */
+    pgtk_widget_path_iter_set_object_name = wine_dlsym(libgtk3, "gtk_widget_path_iter_set_object_name",
+                                                       NULL, 0);
 
     libcairo = wine_dlopen(SONAME_LIBCAIRO, RTLD_NOW, NULL, 0);
 
@@ -273,10 +457,12 @@ static BOOL load_gtk3_libs(void)
     LOAD_FUNCPTR(libcairo, cairo_create)
     LOAD_FUNCPTR(libcairo, cairo_destroy)
     LOAD_FUNCPTR(libcairo, cairo_image_surface_create)
+    LOAD_FUNCPTR(libcairo, cairo_image_surface_create_for_data)
     LOAD_FUNCPTR(libcairo, cairo_image_surface_get_data)
     LOAD_FUNCPTR(libcairo, cairo_image_surface_get_stride)
     LOAD_FUNCPTR(libcairo, cairo_surface_destroy)
     LOAD_FUNCPTR(libcairo, cairo_surface_flush)
+    LOAD_FUNCPTR(libcairo, cairo_translate)
 
     libgobject2 = wine_dlopen(SONAME_LIBGOBJECT_2_0, RTLD_NOW, NULL, 0);
 
@@ -286,7 +472,9 @@ static BOOL load_gtk3_libs(void)
         goto error;
     }
 
-    LOAD_FUNCPTR(libgobject2, g_type_check_instance_is_a)
+    LOAD_FUNCPTR(libgobject2, g_object_get)
+    LOAD_FUNCPTR(libgobject2, g_object_unref)
+    LOAD_FUNCPTR(libgobject2, g_signal_connect_data)
 
     return TRUE;
 
@@ -299,680 +487,1975 @@ error:
 
 #undef LOAD_FUNCPTR
 
-static void init(void)
+/* Runs on the render thread */
+static BOOL load_class_symbols(unsigned int index)
 {
-    static const WCHAR themes_subdir[] = { '\\','T','h','e','m','e','s',0 };
-    static const WCHAR style_folder[] = {'\\', 'g','t','k', 0};
-    static const WCHAR style_file[] = {'\\','g','t','k','.','m','s','s','t','y','l','e','s', 0};
+    const symbol_t *symbol;
 
-    HANDLE file;
+    if (classes_loaded[index] || classes[index].symbols == NULL)
+        return TRUE;
 
-    if (!load_gtk3_libs())
-        return;
+    for (symbol = classes[index].symbols; symbol->name != NULL; symbol++)
+    {
+        if (*symbol->ptr != NULL)
+            continue; /* shared with another class */
 
-    pgtk_init(0, NULL); /* Otherwise every call to GTK will fail */
+        if (!(*symbol->ptr = wine_dlsym(libgtk3, symbol->name, NULL, 0)))
+        {
+            WARN("Can't find symbol %s.\n", symbol->name);
+            return FALSE;
+        }
+    }
 
-    apply_colors();
-    fix_sys_params();
+    classes_loaded[index] = TRUE;
 
-    if (FAILED(SHGetFolderPathW(NULL, CSIDL_RESOURCES|CSIDL_FLAG_CREATE, NULL,
-        SHGFP_TYPE_CURRENT, fake_msstyles_file)))
-    {
-        fake_msstyles_file[0] = 0;
-        return;
-    }
+    return TRUE;
+}
 
-    lstrcatW(fake_msstyles_file, themes_subdir);
-    lstrcatW(fake_msstyles_file, style_folder);
+/* Runs on the render thread */
+static uxgtk_theme_t *create_class_theme(unsigned int index)
+{
+    uxgtk_theme_t *theme;
+    LONGLONG start = classes_loaded[index] ? 0 : begin_phase();
 
-    SHCreateDirectoryExW(NULL, fake_msstyles_file, NULL);
+    if (!load_class_symbols(index))
+        return NULL;
 
-    lstrcatW(fake_msstyles_file, style_file);
+    theme = classes[index].create();
 
-    file = CreateFileW(fake_msstyles_file, GENERIC_WRITE, 0, NULL, CREATE_NEW,
-                       FILE_ATTRIBUTE_NORMAL, NULL);
+    /* Only the first instance pays for the symbols and the CSS of the class */
+    end_phase("create_class", classes[index].classname, start);
 
-    if (file != INVALID_HANDLE_VALUE)
-        CloseHandle(file);
+    return theme;
 }
 
-static void uninit(void)
+/* Runs on the render thread */
+static uxgtk_theme_t *acquire_class_theme(unsigned int index)
 {
-    free_gtk3_libs();
-}
+    uxgtk_theme_t *theme = shared_themes[index];
 
-static void paint_cairo_surface(cairo_surface_t *surface, HDC target_hdc,
-                                int x, int y, int width, int height)
-{
-    int i, dib_stride, cairo_stride;
-    HDC bitmap_hdc;
-    HBITMAP bitmap;
-    BITMAPINFO info;
-    BLENDFUNCTION bf;
-    unsigned char *bitmap_data, *surface_data;
-
-    info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    info.bmiHeader.biWidth = width;
-    info.bmiHeader.biHeight = -height; /* top-down, see MSDN */
-    info.bmiHeader.biPlanes = 1;
-    info.bmiHeader.biBitCount = 32;
-    info.bmiHeader.biCompression = BI_RGB; /* no compression */
-    info.bmiHeader.biSizeImage = 0;
-    info.bmiHeader.biXPelsPerMeter = 1;
-    info.bmiHeader.biYPelsPerMeter = 1;
-    info.bmiHeader.biClrUsed = 0;
-    info.bmiHeader.biClrImportant = 0;
+    if (theme == NULL)
+    {
+        theme = create_class_theme(index);
 
-    bf.BlendOp = AC_SRC_OVER;
-    bf.BlendFlags = 0;
-    bf.SourceConstantAlpha = 0xff;
-    bf.AlphaFormat = AC_SRC_ALPHA;
+        if (theme == NULL)
+            return NULL;
 
-    bitmap_hdc = CreateCompatibleDC(target_hdc);
-    bitmap = CreateDIBSection(bitmap_hdc, &info, DIB_RGB_COLORS,
-                              (void **)&bitmap_data, NULL, 0);
+        theme->refcount = 0;
+        theme->class_index = index;
+        shared_themes[index] = theme;
+    }
 
-    pcairo_surface_flush(surface);
+    theme->refcount++;
 
-    surface_data = pcairo_image_surface_get_data(surface);
-    cairo_stride = pcairo_image_surface_get_stride(surface);
-    dib_stride = width * 4;
+    return theme;
+}
 
-    for (i = 0; i < height; i++)
-        memcpy(bitmap_data + i * dib_stride, surface_data + i * cairo_stride, width * 4);
+static void destroy_theme_proc(void *data);
 
-    SelectObject(bitmap_hdc, bitmap);
+/* Runs on the render thread, destroys the themes parked for long enough */
+static void destroy_parked_themes(void)
+{
+    unsigned int i;
+    uxgtk_theme_t *theme;
+    DWORD now = GetTickCount();
 
-    GdiAlphaBlend(target_hdc, x, y, width, height,
-                  bitmap_hdc, 0, 0, width, height, bf);
+    for (i = 0; i < NUM_CLASSES; i++)
+    {
+        theme = shared_themes[i];
+
+        if (theme == NULL || theme->refcount > 0 || now - parked_since[i] < PARK_DURATION)
+            continue;
+
+        TRACE("Destroying the unused %s theme.\n", debugstr_w(classes[i].classname));
 
-    DeleteObject(bitmap);
-    DeleteDC(bitmap_hdc);
+        shared_themes[i] = NULL;
+        destroy_theme_proc(theme);
+    }
 }
 
-static BOOL match_class(LPCWSTR classlist, LPCWSTR classname)
+/*
+ * Runs on the render thread. Controls are often destroyed and created again
+ * right away, like the pages of a property sheet, so the last release only
+ * parks the theme. Opening the class again revives it as it is.
+ */
+static void release_theme_proc(void *data)
 {
-    WCHAR *last, *tok, buf[CLASSLIST_MAXLEN];
-
-    if (classlist == NULL || classname == NULL)
-        return FALSE;
+    uxgtk_theme_t *theme = data;
 
-    lstrcpynW(buf, classlist, CLASSLIST_MAXLEN - 1);
+    if (theme->refcount <= 0)
+    {
+        WARN("Theme %p is already closed.\n", theme);
+        return;
+    }
 
-    /* Ensure we have a null character at the end of buffer */
-    buf[CLASSLIST_MAXLEN - 1] = L'\0';
+    if (--theme->refcount > 0)
+        return;
 
-    last = buf;
-    for (tok = buf; *tok; tok++)
-    {
-        if (*tok != ';')
-            continue;
+    parked_since[theme->class_index] = GetTickCount();
+}
 
-        *tok = 0;
+/* The handle holds the reference to the theme the caller acquired */
+static HTHEME new_handle(uxgtk_theme_t *theme)
+{
+    HTHEME htheme = uxgtk_handle_alloc(theme);
+    LONG count;
 
-        if (lstrcmpiW(last, classname) == 0)
-            return TRUE;
- 
-        last = tok;
+    if (htheme == NULL)
+    {
+        uxgtk_render_call(release_theme_proc, theme);
+        return NULL;
     }
 
-    if (last != tok && lstrcmpiW(last, classname) == 0)
-        return TRUE;
+    count = InterlockedIncrement(&open_handles[theme->class_index]);
 
-    return FALSE;
+    TRACE("%s: %d open handles.\n", debugstr_w(classes[theme->class_index].classname), count);
+
+    return htheme;
 }
 
-static BOOL is_fake_theme(const WCHAR *path)
+/* Runs on the render thread while it handles the GTK events, see timer_step */
+static void theme_name_changed(GObject *settings, GParamSpec *pspec, gpointer data)
 {
-    BY_HANDLE_FILE_INFORMATION fake_info, file_info;
-    HANDLE fake_handle, file_handle;
-    BOOL ret = FALSE;
+    unsigned int i;
 
-    fake_handle = CreateFileW(fake_msstyles_file, GENERIC_READ,
-                              FILE_SHARE_READ | FILE_SHARE_DELETE | FILE_SHARE_WRITE,
-                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    file_handle = CreateFileW(path, GENERIC_READ,
-                              FILE_SHARE_READ | FILE_SHARE_DELETE | FILE_SHARE_WRITE,
-                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    TRACE("The GTK theme has changed.\n");
 
-    if (file_handle != INVALID_HANDLE_VALUE && fake_handle != INVALID_HANDLE_VALUE)
+    for (i = 0; i < NUM_CLASSES; i++)
     {
-        if (GetFileInformationByHandle(fake_handle, &fake_info) &&
-            GetFileInformationByHandle(file_handle, &file_info))
-        {
-            if (fake_info.dwVolumeSerialNumber == file_info.dwVolumeSerialNumber &&
-                fake_info.nFileIndexHigh == file_info.nFileIndexHigh &&
-                fake_info.nFileIndexLow == file_info.nFileIndexLow)
-            {
-                ret = TRUE;
-            }
-        }
+        if (shared_themes[i] != NULL)
+            uxgtk_style_flush(shared_themes[i]);
     }
 
-    if (file_handle != INVALID_HANDLE_VALUE)
-        CloseHandle(file_handle);
-
-    if (fake_handle != INVALID_HANDLE_VALUE)
-        CloseHandle(fake_handle);
+    uxgtk_cache_flush();
 
-    return ret;
+    publish_colors();
+    queue_apply_colors();
 }
 
-void uxgtk_theme_init(uxgtk_theme_t *theme, const uxgtk_theme_vtable_t *vtable)
+/* Runs on the render thread each time it was idle for TIMER_PERIOD */
+static BOOL timer_step(void)
 {
-    theme->vtable = vtable;
+    /* Nobody runs a GTK main loop, so the settings changes only arrive here */
+    while (pgtk_events_pending())
+        pgtk_main_iteration_do(FALSE);
 
-    theme->window = pgtk_window_new(GTK_WINDOW_TOPLEVEL);
-    theme->layout = pgtk_fixed_new();
+    destroy_parked_themes();
 
-    pgtk_container_add((GtkContainer*)theme->window, theme->layout);
+    return TRUE;
 }
 
-HRESULT WINAPI CloseThemeData(HTHEME htheme)
+/* Runs on the render thread */
+static void init_gtk(void *data)
 {
-    uxgtk_theme_t *theme = (uxgtk_theme_t *)htheme;
+    LONGLONG start = begin_phase();
 
-    TRACE("(%p)\n", htheme);
-
-    if (libgtk3 == NULL)
-        return E_NOTIMPL;
-
-    if (theme == NULL)
-        return E_HANDLE;
+    pgtk_init(0, NULL); /* Otherwise every call to GTK will fail */
 
-    /* Destroy the toplevel widget */
-    pgtk_widget_destroy(theme->window);
+    end_phase("gtk_init", NULL, start);
 
-    free(theme);
+    pg_signal_connect_data(pgtk_settings_get_default(), "notify::gtk-theme-name",
+                           G_CALLBACK(theme_name_changed), NULL, NULL, 0);
+}
 
-    return S_OK;
+/* Class names are plain ASCII, so this is enough for case-insensitivity */
+static inline WCHAR fold_char(WCHAR c)
+{
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
 }
 
-HRESULT WINAPI EnableThemeDialogTexture(HWND hwnd, DWORD flags)
+static inline unsigned int hash_char(unsigned int hash, WCHAR c)
 {
-    HTHEME htheme;
+    return (hash ^ fold_char(c)) * 16777619; /* FNV-1a */
+}
 
-    TRACE("(%p, %u)\n", hwnd, flags);
+#define HASH_INIT 2166136261u
 
-    if (libgtk3 == NULL)
-        return E_NOTIMPL;
+static BOOL equal_names(const WCHAR *name, int len, const WCHAR *classname)
+{
+    int i;
 
-    if (flags & ETDT_USETABTEXTURE)
+    for (i = 0; i < len; i++)
     {
-        htheme = GetWindowTheme(hwnd);
-        OpenThemeData(hwnd, VSCLASS_TAB);
-        CloseThemeData(htheme);
+        if (classname[i] == 0 || fold_char(name[i]) != fold_char(classname[i]))
+            return FALSE;
     }
 
-    return S_OK; /* Always enabled */
-}
-
-HRESULT WINAPI EnableTheming(BOOL enable)
-{
-    TRACE("(%u)\n", enable);
-
-    return S_OK; /* Always enabled */
+    return classname[len] == 0;
 }
 
-HRESULT WINAPI GetCurrentThemeName(LPWSTR filename, int filename_maxlen,
-                                   LPWSTR color, int color_maxlen,
-                                   LPWSTR size, int size_maxlen)
+static void build_class_index(void)
 {
-    TRACE("(%p, %d, %p, %d, %p, %d)\n", filename, filename_maxlen,
-          color, color_maxlen, size, size_maxlen);
+    unsigned int i, hash;
+    const WCHAR *c;
 
-    if (filename != NULL)
-        lstrcpynW(filename, fake_msstyles_file, filename_maxlen);
+    for (i = 0; i < NUM_CLASSES; i++)
+    {
+        hash = HASH_INIT;
 
-    if (color != NULL)
-        lstrcpynW(color, FAKE_COLOR, color_maxlen);
+        for (c = classes[i].classname; *c; c++)
+            hash = hash_char(hash, *c);
 
-    if (size != NULL)
-        lstrcpynW(size, FAKE_SIZE, size_maxlen);
+        while (class_index[hash % CLASS_INDEX_SIZE] != 0)
+            hash++;
 
-    return S_OK;
+        class_index[hash % CLASS_INDEX_SIZE] = i + 1;
+    }
 }
 
-DWORD WINAPI GetThemeAppProperties(void)
+/* Returns the class index or -1 */
+static int find_class(const WCHAR *name, int len, unsigned int hash)
 {
-    TRACE("()\n");
+    unsigned int index;
 
-    return STAP_ALLOW_CONTROLS; /* Non-client drawing is not supported */
-}
+    while ((index = class_index[hash % CLASS_INDEX_SIZE]) != 0)
+    {
+        if (equal_names(name, len, classes[index - 1].classname))
+            return index - 1;
 
-HTHEME WINAPI GetWindowTheme(HWND hwnd)
-{
-    TRACE("(%p)\n", hwnd);
+        hash++;
+    }
 
-    return GetPropW(hwnd, THEME_PROPERTY);
+    return -1;
 }
 
-BOOL WINAPI IsAppThemed(void)
+/*
+ * Resolves a list like "Explorer::ListView;ListView" in a single pass,
+ * the first supported class wins. Returns the class index or -1.
+ */
+static int find_class_in_list(const WCHAR *classlist)
 {
-    TRACE("()\n");
+    const WCHAR *name = classlist, *c;
+    unsigned int hash = HASH_INIT;
+    int index;
 
-    return IsThemeActive();
-}
-
-BOOL WINAPI IsThemeActive(void)
-{
-    TRACE("()\n");
+    for (c = classlist; ; c++)
+    {
+        if (*c == ';' || *c == 0)
+        {
+            if (c > name && (index = find_class(name, c - name, hash)) >= 0)
+                return index;
 
-    if (libgtk3 == NULL)
-        return FALSE;
+            if (*c == 0)
+                return -1;
 
-    return TRUE;
+            name = c + 1;
+            hash = HASH_INIT;
+        }
+        else if (c[0] == ':' && c[1] == ':')
+        {
+            /* Skip the application name, the class is what follows */
+            name = ++c + 1;
+            hash = HASH_INIT;
+        }
+        else
+        {
+            hash = hash_char(hash, *c);
+        }
+    }
 }
 
-BOOL WINAPI IsThemeDialogTextureEnabled(HWND hwnd)
+static BOOL prewarm_step(void);
+
+static BOOL is_prewarm_enabled(void)
 {
-    TRACE("(%p)\n", hwnd);
+    char value[8];
+    DWORD len = GetEnvironmentVariableA("UXTHEMEGTK_PREWARM", value, sizeof(value));
 
-    return TRUE; /* Always enabled */
+    return (len > 0 && len < sizeof(value) && value[0] != '0');
 }
 
-HTHEME WINAPI OpenThemeData(HWND hwnd, LPCWSTR classlist)
+/* Most processes never draw a themed control, so GTK is only loaded on the first use */
+static BOOL CALLBACK init_gtk_once(INIT_ONCE *once, void *param, void **context)
 {
-    int i;
+    HMODULE module;
+    LONGLONG start = begin_phase();
+    BOOL loaded = load_gtk3_libs();
 
-    TRACE("(%p, %s)\n", hwnd, debugstr_w(classlist));
+    end_phase("load_libs", NULL, start);
 
-    if (libgtk3 == NULL)
-    {
-        SetLastError(ERROR_NOT_SUPPORTED);
-        return NULL;
-    }
+    if (!loaded)
+        return TRUE;
 
-    /* comctl32.dll likes to send NULL */
-    if (classlist == NULL)
+    /*
+     * Neither GTK nor the render thread can be shut down while the loader lock
+     * is held, so once GTK is in use the module stays until the process exits.
+     */
+    if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN,
+                            (LPCWSTR)init_gtk_once, &module))
     {
-        SetLastError(ERROR_INVALID_PARAMETER);
-        return NULL;
+        WARN("Failed to pin the module, GTK won't be used.\n");
+        free_gtk3_libs();
+        return TRUE;
     }
 
-    for (i = 0; i < sizeof(classes) / sizeof(classes[0]); i++)
-    {
-        if (match_class(classlist, classes[i].classname))
-        {
-            uxgtk_theme_t *theme;
+    uxgtk_render_init(init_gtk);
+    uxgtk_render_set_timer(timer_step, TIMER_PERIOD);
 
-            TRACE("Using %s for %s.\n", debugstr_w(classes[i].classname),
-                  debugstr_w(classlist));
+    /* Build the themes and render the common parts before the first paint */
+    if (is_prewarm_enabled())
+        uxgtk_render_set_idle(prewarm_step);
 
-            theme = classes[i].create();
+    start = begin_phase();
+    fix_sys_params();
+    end_phase("fix_sys_params", NULL, start);
 
-            SetPropW(hwnd, THEME_PROPERTY, theme);
-            return theme;
-        }
-    }
+    queue_apply_colors();
 
-    FIXME("No matching theme for %s.\n", debugstr_w(classlist));
-    SetLastError(ERROR_NOT_FOUND);
-    return NULL;
+    return TRUE;
 }
 
-void WINAPI SetThemeAppProperties(DWORD flags)
+/* Returns FALSE if GTK is not available */
+static BOOL ensure_gtk(void)
 {
-    TRACE("(%u)\n", flags);
+    InitOnceExecuteOnce(&gtk_init_once, init_gtk_once, NULL, NULL);
+
+    return (libgtk3 != NULL);
 }
 
-HRESULT WINAPI SetWindowTheme(HWND hwnd, LPCWSTR sub_app_name,
-                              LPCWSTR sub_id_list)
+static DWORD CALLBACK prewarm_work_proc(void *arg)
 {
-    TRACE("(%p, %s, %s)\n", hwnd, debugstr_w(sub_app_name),
-          debugstr_w(sub_id_list));
-
-    return E_NOTIMPL;
+    ensure_gtk();
+    return 0;
 }
 
-HRESULT WINAPI GetThemeBool(HTHEME htheme, int part_id, int state_id,
-                            int prop_id, BOOL *value)
+/* The buffer must hold MAX_PATH characters */
+static BOOL get_full_path(const WCHAR *path, WCHAR *full_path)
 {
-    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, value);
+    DWORD len = GetFullPathNameW(path, MAX_PATH, full_path, NULL);
 
-    return E_NOTIMPL;
+    return (len > 0 && len < MAX_PATH);
 }
 
-HRESULT WINAPI GetThemeColor(HTHEME htheme, int part_id, int state_id,
-                             int prop_id, COLORREF *color)
+static BOOL CALLBACK init_fake_theme_once(INIT_ONCE *once, void *param, void **context)
 {
+    static const WCHAR themes_subdir[] = { '\\','T','h','e','m','e','s',0 };
+    static const WCHAR style_folder[] = {'\\', 'g','t','k', 0};
+    static const WCHAR style_file[] = {'\\','g','t','k','.','m','s','s','t','y','l','e','s', 0};
+
+    HANDLE file;
     HRESULT hr;
-    GdkRGBA rgba = {0, 0, 0, 0};
-    uxgtk_theme_t *theme = (uxgtk_theme_t *)htheme;
+    WCHAR full_path[MAX_PATH];
+    LONGLONG start = begin_phase();
 
-    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, color);
+    hr = SHGetFolderPathW(NULL, CSIDL_RESOURCES|CSIDL_FLAG_CREATE, NULL,
+                          SHGFP_TYPE_CURRENT, fake_msstyles_file);
+
+    end_phase("get_folder_path", NULL, start);
+
+    if (FAILED(hr))
+    {
+        fake_msstyles_file[0] = 0;
+        return TRUE;
+    }
+
+    lstrcatW(fake_msstyles_file, themes_subdir);
+    lstrcatW(fake_msstyles_file, style_folder);
+
+    start = begin_phase();
+    SHCreateDirectoryExW(NULL, fake_msstyles_file, NULL);
+    end_phase("create_directory", NULL, start);
+
+    lstrcatW(fake_msstyles_file, style_file);
+
+    /* Keep the path normalized the same way as the paths compared against it */
+    if (get_full_path(fake_msstyles_file, full_path))
+        lstrcpyW(fake_msstyles_file, full_path);
+
+    start = begin_phase();
+
+    /* Remember the identity of the file, the theme file APIs compare against it */
+    file = CreateFileW(fake_msstyles_file, GENERIC_READ,
+                       FILE_SHARE_READ | FILE_SHARE_DELETE | FILE_SHARE_WRITE,
+                       NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        fake_msstyles_info_valid = GetFileInformationByHandle(file, &fake_msstyles_info);
+        CloseHandle(file);
+    }
+
+    end_phase("create_file", NULL, start);
+
+    return TRUE;
+}
+
+/* The fake msstyles file only matters to theme file APIs, which don't need GTK */
+static void ensure_fake_theme(void)
+{
+    InitOnceExecuteOnce(&fake_theme_init_once, init_fake_theme_once, NULL, NULL);
+}
+
+static void init(void)
+{
+    build_class_index();
+    uxgtk_cache_init();
+    uxgtk_dib_init();
+
+    /* Otherwise prewarming would only start with the first themed call */
+    if (is_prewarm_enabled() &&
+        !QueueUserWorkItem(prewarm_work_proc, NULL, WT_EXECUTEDEFAULT))
+        WARN("Failed to queue the prewarming, GTK is loaded on first use.\n");
+}
+
+static void uninit(void)
+{
+    sys_colors_t *old_colors;
+    unsigned int i;
+
+    uxgtk_dib_uninit();
+
+    /* The module is pinned with GTK loaded, see init_gtk_once */
+    if (libgtk3 != NULL)
+        uxgtk_render_uninit();
+
+    /* The render thread might have been filling the cache until now */
+    uxgtk_cache_uninit();
+
+    for (i = 0; i < NUM_CLASSES; i++)
+    {
+        if (open_handles[i] > 0)
+            TRACE("%s: %d handles were never closed.\n", debugstr_w(classes[i].classname),
+                  open_handles[i]);
+    }
+
+    uxgtk_handle_uninit();
+
+    free(sys_colors);
+    sys_colors = applied_sys_colors = NULL;
+
+    while (retired_sys_colors != NULL)
+    {
+        old_colors = retired_sys_colors;
+        retired_sys_colors = old_colors->retired_next;
+        free(old_colors);
+    }
+
+    free_gtk3_libs();
+}
+
+/*
+ * Composites right into the bits of the DIB section selected into the target,
+ * which is the common case for double buffering. Only plain 32 bpp DIBs with
+ * a simple mapping and a rectangular clip region are handled here.
+ */
+static BOOL paint_dib_direct(uxgtk_dib_t *dib, int src_x, int src_y, HDC target_hdc,
+                             int x, int y, int width, int height, BOOL opaque)
+{
+    DIBSECTION info;
+    HBITMAP bitmap;
+    POINT origin;
+    RECT clip_box;
+    int stride, bitmap_height;
+    unsigned char *dst;
+    const unsigned char *src;
+
+    if (GetMapMode(target_hdc) != MM_TEXT || GetGraphicsMode(target_hdc) != GM_COMPATIBLE ||
+        GetLayout(target_hdc) != 0)
+        return FALSE;
+
+    if (GetClipBox(target_hdc, &clip_box) != SIMPLEREGION)
+        return FALSE;
+
+    bitmap = GetCurrentObject(target_hdc, OBJ_BITMAP);
+
+    if (bitmap == NULL || GetObjectW(bitmap, sizeof(info), &info) != sizeof(info))
+        return FALSE; /* not a DIB section, a device or a metafile */
+
+    if (info.dsBm.bmBits == NULL || info.dsBm.bmBitsPixel != 32)
+        return FALSE;
+
+    if (info.dsBmih.biCompression == BI_BITFIELDS &&
+        (info.dsBitfields[0] != 0xff0000 || info.dsBitfields[1] != 0x00ff00 ||
+         info.dsBitfields[2] != 0x0000ff))
+        return FALSE;
+
+    if (info.dsBmih.biCompression != BI_RGB && info.dsBmih.biCompression != BI_BITFIELDS)
+        return FALSE;
+
+    origin.x = x;
+    origin.y = y;
+    LPtoDP(target_hdc, &origin, 1);
+
+    bitmap_height = info.dsBm.bmHeight;
+
+    /* The visible rect is already clipped, but be careful with the bitmap memory */
+    if (origin.x < 0 || origin.y < 0 ||
+        origin.x + width > info.dsBm.bmWidth || origin.y + height > bitmap_height)
+        return FALSE;
+
+    stride = info.dsBm.bmWidthBytes;
+    dst = (unsigned char *)info.dsBm.bmBits + origin.x * 4;
+
+    /* Bottom-up DIBs are walked backwards */
+    if (info.dsBmih.biHeight > 0)
+    {
+        dst += (bitmap_height - 1 - origin.y) * stride;
+        stride = -stride;
+    }
+    else
+    {
+        dst += origin.y * stride;
+    }
+
+    src = dib->bits + src_y * dib->stride + src_x * 4;
+
+    GdiFlush();
+
+    if (opaque)
+        uxgtk_pixels_copy(dst, stride, src, dib->stride, width, height);
+    else
+        uxgtk_pixels_blend(dst, stride, src, dib->stride, width, height);
+
+    return TRUE;
+}
+
+static void paint_dib(uxgtk_dib_t *dib, int src_x, int src_y, HDC target_hdc,
+                      int x, int y, int width, int height, BOOL opaque)
+{
+    BLENDFUNCTION bf;
+
+    if (paint_dib_direct(dib, src_x, src_y, target_hdc, x, y, width, height, opaque))
+        return;
+
+    /* Alpha blending is expensive, so avoid it when possible */
+    if (opaque)
+    {
+        BitBlt(target_hdc, x, y, width, height, dib->hdc, src_x, src_y, SRCCOPY);
+        return;
+    }
+
+    bf.BlendOp = AC_SRC_OVER;
+    bf.BlendFlags = 0;
+    bf.SourceConstantAlpha = 0xff;
+    bf.AlphaFormat = AC_SRC_ALPHA;
+
+    GdiAlphaBlend(target_hdc, x, y, width, height,
+                  dib->hdc, src_x, src_y, width, height, bf);
+}
+
+static BOOL is_fake_theme(const WCHAR *path)
+{
+    BY_HANDLE_FILE_INFORMATION file_info;
+    WCHAR full_path[MAX_PATH];
+    HANDLE file_handle;
+    BOOL ret = FALSE;
+
+    ensure_fake_theme();
+
+    if (path == NULL || fake_msstyles_file[0] == 0)
+        return FALSE;
+
+    /* Usually it's the very path returned by GetCurrentThemeName */
+    if (get_full_path(path, full_path) && lstrcmpiW(full_path, fake_msstyles_file) == 0)
+        return TRUE;
+
+    /* Otherwise it still might be a link or a DOS name of the file */
+    if (!fake_msstyles_info_valid)
+        return FALSE;
+
+    file_handle = CreateFileW(path, GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_DELETE | FILE_SHARE_WRITE,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file_handle == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    if (GetFileInformationByHandle(file_handle, &file_info))
+    {
+        if (fake_msstyles_info.dwVolumeSerialNumber == file_info.dwVolumeSerialNumber &&
+            fake_msstyles_info.nFileIndexHigh == file_info.nFileIndexHigh &&
+            fake_msstyles_info.nFileIndexLow == file_info.nFileIndexLow)
+        {
+            ret = TRUE;
+        }
+    }
+
+    CloseHandle(file_handle);
+
+    return ret;
+}
+
+/* Runs on the render thread */
+void uxgtk_theme_init(uxgtk_theme_t *theme, const uxgtk_theme_vtable_t *vtable)
+{
+    theme->vtable = vtable;
+
+    /* All themes live in one offscreen window, each in its own container */
+    if (host_window == NULL)
+    {
+        host_window = pgtk_offscreen_window_new();
+        host_layout = pgtk_fixed_new();
+
+        pgtk_container_add((GtkContainer*)host_window, host_layout);
+    }
+
+    theme->window = host_window;
+    theme->layout = pgtk_fixed_new();
+
+    list_init(&theme->styles);
+    list_init(&theme->nodes);
+
+    pgtk_container_add((GtkContainer*)host_layout, theme->layout);
+}
+
+static void destroy_theme_proc(void *data)
+{
+    uxgtk_theme_t *theme = data;
+
+    uxgtk_style_free(theme);
+
+    /* Takes the class widgets with it */
+    pgtk_widget_destroy(theme->layout);
+
+    free(theme);
+}
+
+struct create_theme_args
+{
+    unsigned int index;
+    uxgtk_theme_t *theme;
+};
+
+static void create_theme_proc(void *data)
+{
+    struct create_theme_args *args = data;
+
+    args->theme = acquire_class_theme(args->index);
+}
+
+HRESULT WINAPI CloseThemeData(HTHEME htheme)
+{
+    uxgtk_theme_t *theme;
+    LONG count;
+
+    TRACE("(%p)\n", htheme);
 
     if (libgtk3 == NULL)
         return E_NOTIMPL;
 
-    if (theme == NULL || theme->vtable == NULL)
+    /* Also rejects the handles which were already closed */
+    theme = uxgtk_handle_free(htheme);
+
+    if (theme == NULL)
         return E_HANDLE;
 
-    if (theme->vtable->get_color == NULL)
-        return E_NOTIMPL;
+    count = InterlockedDecrement(&open_handles[theme->class_index]);
 
-    if (color == NULL)
-        return E_INVALIDARG;
+    TRACE("%s: %d open handles.\n", debugstr_w(classes[theme->class_index].classname), count);
+
+    uxgtk_render_call(release_theme_proc, theme);
+
+    return S_OK;
+}
+
+HRESULT WINAPI EnableThemeDialogTexture(HWND hwnd, DWORD flags)
+{
+    struct create_theme_args args;
+    HTHEME htheme;
+
+    TRACE("(%p, %u)\n", hwnd, flags);
 
-    hr = theme->vtable->get_color(theme, part_id, state_id, prop_id, &rgba);
+    if (!ensure_gtk())
+        return E_NOTIMPL;
 
-    if (SUCCEEDED(hr) && rgba.alpha > 0)
+    /* The dialog owns its tab theme, which is closed when the window is gone */
+    if ((flags & ETDT_USETABTEXTURE) && hwnd != NULL && uxgtk_window_get_texture(hwnd) == NULL)
     {
-        *color = RGB((int)(0.5 + CLAMP(rgba.red, 0.0, 1.0) * 255.0),
-                     (int)(0.5 + CLAMP(rgba.green, 0.0, 1.0) * 255.0),
-                     (int)(0.5 + CLAMP(rgba.blue, 0.0, 1.0) * 255.0));
-        return S_OK;
+        args.index = find_class_in_list(VSCLASS_TAB);
+        uxgtk_render_call(create_theme_proc, &args);
+
+        if (args.theme != NULL && (htheme = new_handle(args.theme)) != NULL)
+            uxgtk_window_set_texture(hwnd, htheme);
     }
 
-    return E_FAIL;
+    return S_OK; /* Always enabled */
 }
 
-HRESULT WINAPI GetThemeEnumValue(HTHEME htheme, int part_id, int state_id,
-                                 int prop_id, int *value)
+HRESULT WINAPI EnableTheming(BOOL enable)
 {
-    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, value);
+    TRACE("(%u)\n", enable);
 
-    return E_NOTIMPL;
+    return S_OK; /* Always enabled */
 }
 
-HRESULT WINAPI GetThemeFilename(HTHEME htheme, int part_id, int state_id,
-                                int prop_id, LPWSTR filename, int maxlen)
+HRESULT WINAPI GetCurrentThemeName(LPWSTR filename, int filename_maxlen,
+                                   LPWSTR color, int color_maxlen,
+                                   LPWSTR size, int size_maxlen)
 {
-    TRACE("(%p, %d, %d, %d, %p, %d)\n", htheme, part_id, state_id, prop_id,
-          filename, maxlen);
+    TRACE("(%p, %d, %p, %d, %p, %d)\n", filename, filename_maxlen,
+          color, color_maxlen, size, size_maxlen);
 
-    return E_NOTIMPL;
+    ensure_fake_theme();
+
+    if (filename != NULL)
+        lstrcpynW(filename, fake_msstyles_file, filename_maxlen);
+
+    if (color != NULL)
+        lstrcpynW(color, FAKE_COLOR, color_maxlen);
+
+    if (size != NULL)
+        lstrcpynW(size, FAKE_SIZE, size_maxlen);
+
+    return S_OK;
 }
 
-HRESULT WINAPI GetThemeFont(HTHEME htheme, HDC hdc, int part_id, int state_id,
-                            int prop_id, LOGFONTW *font)
+DWORD WINAPI GetThemeAppProperties(void)
 {
-    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, font);
+    TRACE("()\n");
 
-    return E_NOTIMPL;
+    return STAP_ALLOW_CONTROLS; /* Non-client drawing is not supported */
 }
 
-HRESULT WINAPI GetThemeInt(HTHEME htheme, int part_id, int state_id,
-                           int prop_id, int *value)
+HTHEME WINAPI GetWindowTheme(HWND hwnd)
 {
-    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, value);
+    TRACE("(%p)\n", hwnd);
 
-    return E_NOTIMPL;
+    return uxgtk_window_get_theme(hwnd);
 }
 
-HRESULT WINAPI GetThemeIntList(HTHEME htheme, int part_id, int state_id,
-                               int prop_id, INTLIST *intlist)
+BOOL WINAPI IsAppThemed(void)
 {
-    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, intlist);
+    TRACE("()\n");
 
-    return E_NOTIMPL;
+    return IsThemeActive();
 }
 
-HRESULT WINAPI GetThemeMargins(HTHEME htheme, HDC hdc, int part_id, int state_id,
-                               int prop_id, LPRECT rect, MARGINS *margins)
+BOOL WINAPI IsThemeActive(void)
 {
-    TRACE("(%p, %d, %d, %d, %p, %p)\n", htheme, part_id, state_id, prop_id, rect, margins);
+    TRACE("()\n");
 
-    memset(margins, 0, sizeof(MARGINS)); /* Set all margins to 0 */
+    return ensure_gtk();
+}
+
+BOOL WINAPI IsThemeDialogTextureEnabled(HWND hwnd)
+{
+    TRACE("(%p)\n", hwnd);
+
+    return TRUE; /* Always enabled */
+}
+
+HTHEME WINAPI OpenThemeData(HWND hwnd, LPCWSTR classlist)
+{
+    struct create_theme_args args;
+    HTHEME htheme;
+    int i;
+
+    TRACE("(%p, %s)\n", hwnd, debugstr_w(classlist));
+
+    if (!ensure_gtk())
+    {
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return NULL;
+    }
+
+    /* comctl32.dll likes to send NULL */
+    if (classlist == NULL)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    i = find_class_in_list(classlist);
+
+    if (i < 0)
+    {
+        FIXME("No matching theme for %s.\n", debugstr_w(classlist));
+        SetLastError(ERROR_NOT_FOUND);
+        return NULL;
+    }
+
+    TRACE("Using %s for %s.\n", debugstr_w(classes[i].classname), debugstr_w(classlist));
+
+    args.index = i;
+    uxgtk_render_call(create_theme_proc, &args);
+
+    if (args.theme == NULL)
+    {
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return NULL;
+    }
+
+    htheme = new_handle(args.theme);
+
+    if (htheme == NULL)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+
+    /* The previous handle of the window still belongs to the caller */
+    uxgtk_window_set_theme(hwnd, htheme);
+    return htheme;
+}
+
+void WINAPI SetThemeAppProperties(DWORD flags)
+{
+    TRACE("(%u)\n", flags);
+}
+
+HRESULT WINAPI SetWindowTheme(HWND hwnd, LPCWSTR sub_app_name,
+                              LPCWSTR sub_id_list)
+{
+    TRACE("(%p, %s, %s)\n", hwnd, debugstr_w(sub_app_name),
+          debugstr_w(sub_id_list));
+
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI GetThemeBool(HTHEME htheme, int part_id, int state_id,
+                            int prop_id, BOOL *value)
+{
+    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, value);
+
+    return E_NOTIMPL;
+}
+
+struct get_color_args
+{
+    uxgtk_theme_t *theme;
+    int part_id;
+    int state_id;
+    int prop_id;
+    GdkRGBA rgba;
+    HRESULT hr;
+};
+
+static void get_color_proc(void *data)
+{
+    struct get_color_args *args = data;
+
+    args->hr = args->theme->vtable->get_color(args->theme, args->part_id, args->state_id,
+                                              args->prop_id, &args->rgba);
+}
+
+/* Fully transparent colors are treated as missing */
+static BOOL rgba_to_colorref(const GdkRGBA *rgba, COLORREF *color)
+{
+    if (rgba->alpha <= 0)
+        return FALSE;
+
+    *color = RGB((int)(0.5 + CLAMP(rgba->red, 0.0, 1.0) * 255.0),
+                 (int)(0.5 + CLAMP(rgba->green, 0.0, 1.0) * 255.0),
+                 (int)(0.5 + CLAMP(rgba->blue, 0.0, 1.0) * 255.0));
+
+    return TRUE;
+}
+
+static HRESULT get_theme_color(uxgtk_theme_t *theme, int part_id, int state_id,
+                               int prop_id, COLORREF *color)
+{
+    struct get_color_args args;
+
+    if (theme->vtable == NULL)
+        return E_HANDLE;
+
+    if (theme->vtable->get_color == NULL)
+        return E_NOTIMPL;
+
+    if (color == NULL)
+        return E_INVALIDARG;
+
+    args.theme = theme;
+    args.part_id = part_id;
+    args.state_id = state_id;
+    args.prop_id = prop_id;
+    args.rgba.red = args.rgba.green = args.rgba.blue = args.rgba.alpha = 0;
+
+    uxgtk_render_call(get_color_proc, &args);
+
+    if (SUCCEEDED(args.hr) && rgba_to_colorref(&args.rgba, color))
+        return S_OK;
+
+    return E_FAIL;
+}
+
+HRESULT WINAPI GetThemeColor(HTHEME htheme, int part_id, int state_id,
+                             int prop_id, COLORREF *color)
+{
+    HRESULT hr;
+    uxgtk_theme_t *theme;
+
+    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, color);
+
+    if (libgtk3 == NULL)
+        return E_NOTIMPL;
+
+    theme = uxgtk_handle_get(htheme);
+    if (theme == NULL)
+        return E_HANDLE;
+
+    hr = get_theme_color(theme, part_id, state_id, prop_id, color);
+
+    uxgtk_handle_put(htheme);
+
+    return hr;
+}
+
+HRESULT WINAPI GetThemeEnumValue(HTHEME htheme, int part_id, int state_id,
+                                 int prop_id, int *value)
+{
+    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, value);
+
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI GetThemeFilename(HTHEME htheme, int part_id, int state_id,
+                                int prop_id, LPWSTR filename, int maxlen)
+{
+    TRACE("(%p, %d, %d, %d, %p, %d)\n", htheme, part_id, state_id, prop_id,
+          filename, maxlen);
+
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI GetThemeFont(HTHEME htheme, HDC hdc, int part_id, int state_id,
+                            int prop_id, LOGFONTW *font)
+{
+    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, font);
+
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI GetThemeInt(HTHEME htheme, int part_id, int state_id,
+                           int prop_id, int *value)
+{
+    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, value);
+
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI GetThemeIntList(HTHEME htheme, int part_id, int state_id,
+                               int prop_id, INTLIST *intlist)
+{
+    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, intlist);
+
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI GetThemeMargins(HTHEME htheme, HDC hdc, int part_id, int state_id,
+                               int prop_id, LPRECT rect, MARGINS *margins)
+{
+    TRACE("(%p, %d, %d, %d, %p, %p)\n", htheme, part_id, state_id, prop_id, rect, margins);
+
+    memset(margins, 0, sizeof(MARGINS)); /* Set all margins to 0 */
+
+    return S_OK;
+}
+
+HRESULT WINAPI GetThemeMetric(HTHEME htheme, HDC hdc, int part_id, int state_id,
+                              int prop_id, int *value)
+{
+    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, value);
+
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI GetThemePosition(HTHEME htheme, int part_id, int state_id,
+                                int prop_id, POINT *point)
+{
+    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, point);
+
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI GetThemePropertyOrigin(HTHEME htheme, int part_id, int state_id,
+                                      int prop_id, PROPERTYORIGIN *origin)
+{
+    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, origin);
+
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI GetThemeRect(HTHEME htheme, int part_id, int state_id,
+                            int prop_id, RECT *rect)
+{
+    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, rect);
+
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI GetThemeString(HTHEME htheme, int part_id, int state_id,
+                              int prop_id, LPWSTR buffer, int maxlen)
+{
+    TRACE("(%p, %d, %d, %d, %p, %d)\n", htheme, part_id, state_id, prop_id, buffer,
+          maxlen);
+
+    return E_NOTIMPL;
+}
+
+static void get_enable_animations_proc(void *data)
+{
+    pg_object_get(pgtk_settings_get_default(), "gtk-enable-animations", data, NULL);
+}
+
+static HRESULT get_transition_duration(uxgtk_theme_t *theme, int part_id, int state_id_from,
+                                       int state_id_to, int prop_id, DWORD *duration)
+{
+    gboolean enable_animations = TRUE;
+
+    if (theme->vtable == NULL)
+        return E_HANDLE;
+
+    if (duration == NULL)
+        return E_INVALIDARG;
+
+    if (prop_id != TMT_TRANSITIONDURATIONS)
+        return E_PROP_ID_UNSUPPORTED;
+
+    *duration = 0;
+
+    if (state_id_from == state_id_to)
+        return S_OK;
+
+    if (theme->vtable->is_part_defined != NULL &&
+        !theme->vtable->is_part_defined(part_id, state_id_to))
+        return S_OK;
+
+    uxgtk_render_call(get_enable_animations_proc, &enable_animations);
+
+    if (enable_animations)
+        *duration = TRANSITION_DURATION;
+
+    return S_OK;
+}
+
+/*
+ * Returns a fixed duration for any change of state while GTK animations are
+ * enabled. This is a deliberate approximation: GTK 3 keeps the CSS
+ * transition-duration private, so the 200 ms of the Adwaita buttons are used
+ * for every part, whatever the theme actually declares.
+ */
+HRESULT WINAPI GetThemeTransitionDuration(HTHEME htheme, int part_id, int state_id_from,
+                                          int state_id_to, int prop_id, DWORD *duration)
+{
+    HRESULT hr;
+    uxgtk_theme_t *theme;
+
+    TRACE("(%p, %d, %d, %d, %d, %p)\n", htheme, part_id, state_id_from, state_id_to, prop_id,
+          duration);
+
+    if (libgtk3 == NULL)
+        return E_NOTIMPL;
+
+    theme = uxgtk_handle_get(htheme);
+    if (theme == NULL)
+        return E_HANDLE;
+
+    hr = get_transition_duration(theme, part_id, state_id_from, state_id_to, prop_id, duration);
+
+    uxgtk_handle_put(htheme);
+
+    return hr;
+}
+
+BOOL WINAPI GetThemeSysBool(HTHEME htheme, int bool_id)
+{
+    TRACE("(%p, %d)\n", htheme, bool_id);
+
+    SetLastError(ERROR_NOT_SUPPORTED);
+
+    return FALSE;
+}
+
+/* Each source is queried once per refresh, whatever the number of colors using it */
+enum
+{
+    SYS_COLOR_FACE,
+    SYS_COLOR_SHADOW,
+    SYS_COLOR_TEXT,
+    SYS_COLOR_SELECTED_TEXT,
+    SYS_COLOR_GRAY_TEXT,
+    SYS_COLOR_SELECTED,
+    SYS_COLOR_MENUBAR,
+    SYS_COLOR_MENU,
+    SYS_COLOR_MENU_TEXT,
+    SYS_COLOR_WINDOW,
+    NUM_SYS_COLOR_SOURCES
+};
+
+static const struct {
+    const WCHAR *classname;
+    int part_id;
+    int state_id;
+    int prop_id;
+} sys_color_sources[NUM_SYS_COLOR_SOURCES] = {
+    { VSCLASS_WINDOW, WP_DIALOG,            0,            TMT_FILLCOLOR },
+    { VSCLASS_BUTTON, BP_PUSHBUTTON,        PBS_NORMAL,   TMT_BORDERCOLOR },
+    { VSCLASS_WINDOW, WP_DIALOG,            0,            TMT_TEXTCOLOR },
+    { VSCLASS_EDIT,   EP_EDITTEXT,          ETS_SELECTED, TMT_TEXTCOLOR },
+    { VSCLASS_BUTTON, BP_PUSHBUTTON,        PBS_DISABLED, TMT_TEXTCOLOR },
+    { VSCLASS_EDIT,   EP_EDITTEXT,          ETS_SELECTED, TMT_FILLCOLOR },
+    { VSCLASS_MENU,   MENU_BARBACKGROUND,   MB_ACTIVE,    TMT_FILLCOLOR },
+    { VSCLASS_MENU,   MENU_POPUPBACKGROUND, 0,            TMT_FILLCOLOR },
+    { VSCLASS_MENU,   MENU_POPUPITEM,       MPI_NORMAL,   TMT_TEXTCOLOR },
+    { VSCLASS_EDIT,   EP_EDITTEXT,          ETS_NORMAL,   TMT_FILLCOLOR }
+};
+
+/* Returns the source of the color or -1 */
+static int get_sys_color_source(int color_id)
+{
+    switch (color_id)
+    {
+        case COLOR_BTNFACE:
+        case COLOR_SCROLLBAR:
+        case COLOR_WINDOWFRAME:
+        case COLOR_INACTIVECAPTION:
+        case COLOR_GRADIENTINACTIVECAPTION:
+        case COLOR_3DDKSHADOW:
+        case COLOR_BTNHIGHLIGHT:
+        case COLOR_ACTIVEBORDER:
+        case COLOR_INACTIVEBORDER:
+        case COLOR_APPWORKSPACE:
+        case COLOR_BACKGROUND:
+        case COLOR_ACTIVECAPTION:
+        case COLOR_GRADIENTACTIVECAPTION:
+        case COLOR_ALTERNATEBTNFACE:
+        case COLOR_INFOBK: /* FIXME */
+            return SYS_COLOR_FACE;
+
+        case COLOR_3DLIGHT:
+        case COLOR_BTNSHADOW:
+            return SYS_COLOR_SHADOW;
+
+        case COLOR_BTNTEXT:
+        case COLOR_INFOTEXT:
+        case COLOR_WINDOWTEXT:
+        case COLOR_CAPTIONTEXT:
+            return SYS_COLOR_TEXT;
+
+        case COLOR_HIGHLIGHTTEXT:
+            return SYS_COLOR_SELECTED_TEXT;
+
+        case COLOR_GRAYTEXT:
+        case COLOR_INACTIVECAPTIONTEXT:
+            return SYS_COLOR_GRAY_TEXT;
+
+        case COLOR_HIGHLIGHT:
+        case COLOR_MENUHILIGHT:
+        case COLOR_HOTLIGHT:
+            return SYS_COLOR_SELECTED;
+
+        case COLOR_MENUBAR:
+            return SYS_COLOR_MENUBAR;
+
+        case COLOR_MENU:
+            return SYS_COLOR_MENU;
+
+        case COLOR_MENUTEXT:
+            return SYS_COLOR_MENU_TEXT;
+
+        case COLOR_WINDOW:
+            return SYS_COLOR_WINDOW;
+    }
+
+    FIXME("Unknown color %d.\n", color_id);
+    return -1;
+}
+
+/* Runs on the render thread */
+static BOOL query_sys_color_source(int source, COLORREF *color)
+{
+    uxgtk_theme_t *theme;
+    GdkRGBA rgba;
+    HRESULT hr = E_FAIL;
+    int index = find_class_in_list(sys_color_sources[source].classname);
+
+    theme = index >= 0 ? acquire_class_theme(index) : NULL;
+
+    if (theme == NULL)
+        return FALSE;
+
+    rgba.red = rgba.green = rgba.blue = rgba.alpha = 0;
+
+    if (theme->vtable->get_color != NULL)
+        hr = theme->vtable->get_color(theme, sys_color_sources[source].part_id,
+                                      sys_color_sources[source].state_id,
+                                      sys_color_sources[source].prop_id, &rgba);
+
+    release_theme_proc(theme);
+
+    return SUCCEEDED(hr) && rgba_to_colorref(&rgba, color);
+}
+
+/* Runs on the render thread, builds the whole table in one pass */
+static sys_colors_t *create_sys_colors(void)
+{
+    sys_colors_t *snapshot;
+    COLORREF sources[NUM_SYS_COLOR_SOURCES];
+    BOOL valid[NUM_SYS_COLOR_SOURCES];
+    int i, source;
+
+    snapshot = malloc(sizeof(*snapshot));
+    if (snapshot == NULL)
+        return NULL;
+
+    for (i = 0; i < NUM_SYS_COLOR_SOURCES; i++)
+        valid[i] = query_sys_color_source(i, &sources[i]);
+
+    for (i = 0; i < NUM_SYS_COLORS; i++)
+    {
+        source = get_sys_color_source(i);
+
+        if (source >= 0 && valid[source])
+            snapshot->colors[i] = sources[source];
+        else
+            snapshot->colors[i] = GetSysColor(i);
+    }
+
+    snapshot->retired_next = NULL;
+
+    return snapshot;
+}
+
+/* Runs on the render thread */
+static void first_colors_proc(void *data)
+{
+    LONGLONG start;
+
+    /* Another thread might have been first */
+    if (sys_colors != NULL)
+        return;
+
+    start = begin_phase();
+    publish_colors();
+    end_phase("publish_colors", NULL, start);
+}
+
+/* The first table is built on demand, so the startup procedure stays short */
+static sys_colors_t *get_sys_colors(void)
+{
+    if (sys_colors == NULL)
+        uxgtk_render_call(first_colors_proc, NULL);
+
+    return sys_colors;
+}
+
+/* Only an array load, the table is replaced as a whole by publish_colors */
+COLORREF WINAPI GetThemeSysColor(HTHEME htheme, int color_id)
+{
+    sys_colors_t *snapshot;
+
+    TRACE("(%p, %d)\n", htheme, color_id);
+
+    if (!ensure_gtk())
+        return GetSysColor(color_id);
+
+    snapshot = get_sys_colors();
+
+    if (snapshot == NULL || color_id < 0 || color_id >= NUM_SYS_COLORS)
+        return GetSysColor(color_id);
+
+    return snapshot->colors[color_id];
+}
+
+/* Runs on the render thread, queue_apply_colors passes the table to SetSysColors */
+static void publish_colors(void)
+{
+    sys_colors_t *snapshot = create_sys_colors(), *old;
+
+    if (snapshot == NULL)
+        return;
+
+    old = InterlockedExchangePointer((void **)&sys_colors, snapshot);
+
+    /* Other threads might still be reading the old table */
+    if (old != NULL)
+    {
+        old->retired_next = retired_sys_colors;
+        retired_sys_colors = old;
+    }
+}
+
+static DWORD CALLBACK apply_colors_proc(void *arg)
+{
+    sys_colors_t *snapshot = get_sys_colors(), *applied = applied_sys_colors;
+    int i, ids[NUM_SYS_COLORS];
+
+    if (snapshot == NULL || snapshot == applied)
+        return 0;
+
+    /* Only one work item applies each table */
+    if (InterlockedCompareExchangePointer((void **)&applied_sys_colors, snapshot, applied) != applied)
+        return 0;
+
+    for (i = 0; i < NUM_SYS_COLORS; i++)
+        ids[i] = i;
+
+    SetSysColors(NUM_SYS_COLORS, ids, snapshot->colors);
+
+    return 0;
+}
+
+/*
+ * SetSysColors sends WM_SYSCOLORCHANGE to every window and waits for them,
+ * so neither the render thread, which other threads wait for, nor a thread
+ * drawing a control must call it. A worker thread applies the colors instead.
+ * Until it is done, GetSysColor still returns the previous colors, so the
+ * first paint of a process might mix them with the GTK ones.
+ */
+static void queue_apply_colors(void)
+{
+    if (!QueueUserWorkItem(apply_colors_proc, NULL, WT_EXECUTEDEFAULT))
+        WARN("Failed to queue the system colors.\n");
+}
+
+HBRUSH WINAPI GetThemeSysColorBrush(HTHEME htheme, int color_id)
+{
+    TRACE("(%p, %d)\n", htheme, color_id);
+
+    return CreateSolidBrush(GetThemeSysColor(htheme, color_id));
+}
+
+HRESULT WINAPI GetThemeSysFont(HTHEME htheme, int font_id, LOGFONTW *font)
+{
+    TRACE("(%p, %d, %p)\n", htheme, font_id, font);
+
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI GetThemeSysInt(HTHEME htheme, int int_id, int *value)
+{
+    TRACE("(%p, %d, %p)\n", htheme, int_id, value);
+
+    return E_NOTIMPL;
+}
+
+int WINAPI GetThemeSysSize(HTHEME htheme, int size_id)
+{
+    TRACE("(%p, %d)\n", htheme, size_id);
+ 
+    SetLastError(ERROR_NOT_SUPPORTED);
+
+    return -1;
+}
+
+HRESULT WINAPI GetThemeSysString(HTHEME htheme, int string_id,
+                                 LPWSTR buffer, int maxlen)
+{
+    TRACE("(%p, %d, %p, %d)\n", htheme, string_id, buffer, maxlen);
+
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI DrawThemeBackground(HTHEME htheme, HDC hdc, int part_id, int state_id,
+                                   LPCRECT rect, LPCRECT clip_rect)
+{
+    DTBGOPTS opts;
+
+    TRACE("(%p, %p, %d, %d, %p, %p)\n", htheme, hdc, part_id, state_id, rect, clip_rect);
+
+    opts.dwSize = sizeof(DTBGOPTS);
+    opts.dwFlags = 0;
+
+    if (clip_rect != NULL)
+    {
+        opts.dwFlags = DTBG_CLIPRECT;
+        CopyRect(&opts.rcClip, clip_rect);
+    }
+
+    return DrawThemeBackgroundEx(htheme, hdc, part_id, state_id, rect, &opts);
+}
+
+/* Renders the part straight into the given ARGB32 buffer */
+struct draw_part_args
+{
+    uxgtk_theme_t *theme;
+    int part_id;
+    int state_id;
+    int width;
+    int height;
+    const RECT *area;
+    unsigned char *bits;
+    int stride;
+    HRESULT hr;
+};
+
+static void draw_part_proc(void *data)
+{
+    struct draw_part_args *args = data;
+    cairo_t *cr;
+    cairo_surface_t *surface;
+    const RECT *area = args->area;
+
+    surface = pcairo_image_surface_create_for_data(args->bits, CAIRO_FORMAT_ARGB32,
+                                                   area->right - area->left,
+                                                   area->bottom - area->top, args->stride);
+    cr = pcairo_create(surface);
+
+    if (area->left != 0 || area->top != 0)
+        pcairo_translate(cr, -area->left, -area->top);
+
+    args->hr = args->theme->vtable->draw_background(args->theme, cr, args->part_id,
+                                                    args->state_id, args->width, args->height);
+
+    pcairo_destroy(cr);
+
+    pcairo_surface_flush(surface);
+    pcairo_surface_destroy(surface);
+}
+
+/* Rasterizes the area of a width x height part, the bits have the size of the area */
+static HRESULT draw_part(uxgtk_theme_t *theme, int part_id, int state_id, int width, int height,
+                         const RECT *area, unsigned char *bits, int stride)
+{
+    int i;
+    struct draw_part_args args;
+
+    /* Buffers are reused, so clear the old content */
+    for (i = 0; i < area->bottom - area->top; i++)
+        memset(bits + i * stride, 0, (area->right - area->left) * 4);
+
+    args.theme = theme;
+    args.part_id = part_id;
+    args.state_id = state_id;
+    args.width = width;
+    args.height = height;
+    args.area = area;
+    args.bits = bits;
+    args.stride = stride;
+
+    /* Only GTK runs on the render thread, the caller does the rest */
+    uxgtk_render_call(draw_part_proc, &args);
+
+    return args.hr;
+}
+
+static HRESULT draw_full_part(uxgtk_theme_t *theme, int part_id, int state_id,
+                              int width, int height, unsigned char *bits, int stride)
+{
+    RECT area;
+
+    SetRect(&area, 0, 0, width, height);
+
+    return draw_part(theme, part_id, state_id, width, height, &area, bits, stride);
+}
+
+struct stretch_args
+{
+    int inset;
+    int width;
+    int height;
+    const RECT *area;
+    unsigned char *bits;
+    int stride;
+    BOOL stretched;
+};
+
+static void stretch_bitmap(const uxgtk_bitmap_t *bitmap, void *context)
+{
+    struct stretch_args *args = context;
+
+    args->stretched = uxgtk_stretch_nine_slice(bitmap, args->inset, args->width, args->height,
+                                               args->area, args->bits, args->stride);
+}
+
+/*
+ * Rebuilds the area of the part from the nine slices of its canonical rendering,
+ * which is cheap enough for parts as large as a window
+ */
+static HRESULT draw_stretched_part(uxgtk_theme_t *theme, const uxgtk_cache_key_t *key, int inset,
+                                   const RECT *area, unsigned char *bits, int stride)
+{
+    HRESULT hr;
+    uxgtk_bitmap_t source;
+    uxgtk_cache_key_t canonical_key;
+    struct stretch_args args;
+    unsigned char canonical[SLICE_CANONICAL_SIZE * SLICE_CANONICAL_SIZE * 4];
+
+    canonical_key = *key;
+    canonical_key.width = SLICE_CANONICAL_SIZE;
+    canonical_key.height = SLICE_CANONICAL_SIZE;
+
+    args.inset = inset;
+    args.width = key->width;
+    args.height = key->height;
+    args.area = area;
+    args.bits = bits;
+    args.stride = stride;
+    args.stretched = FALSE;
+
+    /* The slices are read straight from the cache */
+    if (!uxgtk_cache_lookup(&canonical_key, stretch_bitmap, &args))
+    {
+        source.width = SLICE_CANONICAL_SIZE;
+        source.height = SLICE_CANONICAL_SIZE;
+        source.stride = SLICE_CANONICAL_SIZE * 4;
+        source.data = canonical;
+
+        hr = draw_full_part(theme, key->part_id, key->state_id, source.width, source.height,
+                            source.data, source.stride);
+
+        if (FAILED(hr))
+            return hr;
+
+        source.opaque = uxgtk_pixels_opaque(source.data, source.stride,
+                                            source.width, source.height);
+        uxgtk_cache_insert(&canonical_key, source.data, source.stride, source.opaque);
+
+        stretch_bitmap(&source, &args);
+    }
+
+    if (args.stretched)
+        return S_OK;
+
+    return draw_part(theme, key->part_id, key->state_id, key->width, key->height, area,
+                     bits, stride);
+}
+
+struct get_slice_inset_args
+{
+    uxgtk_theme_t *theme;
+    int part_id;
+    int state_id;
+    int inset;
+};
+
+static void get_slice_inset_proc(void *data)
+{
+    struct get_slice_inset_args *args = data;
+    GtkStyleContext *context;
+
+    context = args->theme->vtable->get_stretch_context(args->theme, args->part_id, args->state_id);
+
+    args->inset = (context != NULL) ? uxgtk_style_get_slice_inset(context) : -1;
+}
+
+/*
+ * Returns how many pixels at each edge of the part have to be kept as they are
+ * when it is stretched, -1 if the part can't be stretched to the given size
+ */
+static int get_slice_inset(uxgtk_theme_t *theme, int part_id, int state_id, int width, int height)
+{
+    struct get_slice_inset_args args;
+
+    if (theme->vtable->get_stretch_context == NULL)
+        return -1;
+
+    args.theme = theme;
+    args.part_id = part_id;
+    args.state_id = state_id;
+
+    uxgtk_render_call(get_slice_inset_proc, &args);
+
+    /* Rounder frames don't fit into the canonical rendering, GTK draws them then */
+    if (args.inset < 0 || args.inset * 2 >= SLICE_CANONICAL_SIZE)
+        return -1;
+
+    if (width <= args.inset * 2 || height <= args.inset * 2)
+        return -1;
+
+    return args.inset;
+}
+
+/* Returns FALSE if nothing of the rect is visible */
+static BOOL get_visible_rect(HDC hdc, const RECT *rect, const DTBGOPTS *options, RECT *visible)
+{
+    RECT clip_box;
+
+    CopyRect(visible, rect);
+
+    if (IsRectEmpty(visible))
+        return FALSE;
+
+    if (options != NULL && (options->dwFlags & DTBG_CLIPRECT))
+    {
+        if (!IntersectRect(visible, visible, &options->rcClip))
+            return FALSE;
+    }
+
+    switch (GetClipBox(hdc, &clip_box))
+    {
+        case ERROR:
+            break; /* Let GDI handle it */
+
+        case NULLREGION:
+            return FALSE;
+
+        default:
+            if (!IntersectRect(visible, visible, &clip_box))
+                return FALSE;
+    }
+
+    return TRUE;
+}
+
+struct copy_args
+{
+    const RECT *area;
+    uxgtk_dib_t *dib;
+    BOOL opaque;
+};
+
+static void copy_bitmap(const uxgtk_bitmap_t *bitmap, void *context)
+{
+    struct copy_args *args = context;
+    const RECT *area = args->area;
+
+    uxgtk_pixels_copy(args->dib->bits, args->dib->stride,
+                      bitmap->data + area->top * bitmap->stride + area->left * 4,
+                      bitmap->stride, area->right - area->left, area->bottom - area->top);
+    args->opaque = bitmap->opaque;
+}
+
+/*
+ * Renders the given area of a width x height part into a DIB section,
+ * the area starts at (*src_x, *src_y) in the returned DIB.
+ */
+static HRESULT render_part(uxgtk_theme_t *theme, int part_id, int state_id,
+                           int width, int height, const RECT *area,
+                           uxgtk_dib_t **result, int *src_x, int *src_y, BOOL *opaque)
+{
+    HRESULT hr;
+    RECT full;
+    int inset;
+    uxgtk_dib_t *dib;
+    uxgtk_cache_key_t key;
+    struct copy_args copy;
+    int area_width = area->right - area->left;
+    int area_height = area->bottom - area->top;
+
+    key.vtable = theme->vtable;
+    key.part_id = part_id;
+    key.state_id = state_id;
+    key.width = width;
+    key.height = height;
+
+    /* The same parts are drawn over and over again, so don't bother GTK */
+    if (uxgtk_cache_accepts(width, height))
+    {
+        copy.area = area;
+        copy.dib = uxgtk_dib_acquire(area_width, area_height);
+
+        if (copy.dib == NULL)
+            return E_OUTOFMEMORY;
+
+        if (uxgtk_cache_lookup(&key, copy_bitmap, &copy))
+        {
+            *opaque = copy.opaque;
+            *src_x = *src_y = 0;
+            *result = copy.dib;
+            return S_OK;
+        }
+
+        uxgtk_dib_release(copy.dib);
+
+        /* Small parts are rendered completely to be reused later */
+        dib = uxgtk_dib_acquire(width, height);
+
+        if (dib == NULL)
+            return E_OUTOFMEMORY;
+
+        SetRect(&full, 0, 0, width, height);
+        inset = get_slice_inset(theme, part_id, state_id, width, height);
+
+        if (inset >= 0)
+            hr = draw_stretched_part(theme, &key, inset, &full, dib->bits, dib->stride);
+        else
+            hr = draw_part(theme, part_id, state_id, width, height, &full, dib->bits, dib->stride);
+
+        if (FAILED(hr))
+        {
+            uxgtk_dib_release(dib);
+            return hr;
+        }
+
+        *opaque = uxgtk_pixels_opaque(dib->bits, dib->stride, width, height);
+        uxgtk_opacity_update(theme->vtable, part_id, state_id, *opaque);
+        uxgtk_cache_insert(&key, dib->bits, dib->stride, *opaque);
+
+        *src_x = area->left;
+        *src_y = area->top;
+    }
+    else
+    {
+        /* Large parts are often mostly hidden, so only rasterize what is visible */
+        dib = uxgtk_dib_acquire(area_width, area_height);
+
+        if (dib == NULL)
+            return E_OUTOFMEMORY;
+
+        /* Like a tab pane or an edit resized with its window, GTK isn't involved then */
+        inset = get_slice_inset(theme, part_id, state_id, width, height);
+
+        if (inset >= 0)
+            hr = draw_stretched_part(theme, &key, inset, area, dib->bits, dib->stride);
+        else
+            hr = draw_part(theme, part_id, state_id, width, height, area, dib->bits, dib->stride);
+
+        if (FAILED(hr))
+        {
+            uxgtk_dib_release(dib);
+            return hr;
+        }
+
+        *opaque = uxgtk_pixels_opaque(dib->bits, dib->stride, area_width, area_height);
+
+        /* A visible piece tells nothing about the opacity of the hidden rest */
+        if (!*opaque || (area_width == width && area_height == height))
+            uxgtk_opacity_update(theme->vtable, part_id, state_id, *opaque);
+
+        *src_x = *src_y = 0;
+    }
+
+    *result = dib;
 
     return S_OK;
 }
 
-HRESULT WINAPI GetThemeMetric(HTHEME htheme, HDC hdc, int part_id, int state_id,
-                              int prop_id, int *value)
+static HRESULT draw_part_background(uxgtk_theme_t *theme, HDC hdc, int part_id, int state_id,
+                                    LPCRECT rect, const DTBGOPTS *options)
 {
-    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, value);
+    HRESULT hr;
+    BOOL opaque;
+    RECT visible, area;
+    uxgtk_dib_t *dib;
+    int src_x, src_y;
 
-    return E_NOTIMPL;
-}
+    if (theme->vtable == NULL)
+        return E_HANDLE;
 
-HRESULT WINAPI GetThemePosition(HTHEME htheme, int part_id, int state_id,
-                                int prop_id, POINT *point)
-{
-    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, point);
+    if (theme->vtable->draw_background == NULL)
+        return E_NOTIMPL;
 
-    return E_NOTIMPL;
-}
+    if (!get_visible_rect(hdc, rect, options, &visible))
+        return S_OK;
 
-HRESULT WINAPI GetThemePropertyOrigin(HTHEME htheme, int part_id, int state_id,
-                                      int prop_id, PROPERTYORIGIN *origin)
-{
-    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, origin);
+    /* The visible area relative to the part */
+    area = visible;
+    OffsetRect(&area, -rect->left, -rect->top);
 
-    return E_NOTIMPL;
-}
+    hr = render_part(theme, part_id, state_id, rect->right - rect->left,
+                     rect->bottom - rect->top, &area, &dib, &src_x, &src_y, &opaque);
 
-HRESULT WINAPI GetThemeRect(HTHEME htheme, int part_id, int state_id,
-                            int prop_id, RECT *rect)
-{
-    TRACE("(%p, %d, %d, %d, %p)\n", htheme, part_id, state_id, prop_id, rect);
+    if (FAILED(hr))
+        return hr;
 
-    return E_NOTIMPL;
-}
+    paint_dib(dib, src_x, src_y, hdc, visible.left, visible.top,
+              visible.right - visible.left, visible.bottom - visible.top, opaque);
 
-HRESULT WINAPI GetThemeString(HTHEME htheme, int part_id, int state_id,
-                              int prop_id, LPWSTR buffer, int maxlen)
-{
-    TRACE("(%p, %d, %d, %d, %p, %d)\n", htheme, part_id, state_id, prop_id, buffer,
-          maxlen);
+    uxgtk_dib_release(dib);
 
-    return E_NOTIMPL;
+    return S_OK;
 }
 
-HRESULT WINAPI GetThemeTransitionDuration(HTHEME htheme, int part_id, int state_id_from,
-                                          int state_id_to, int prop_id, DWORD *duration)
+HRESULT WINAPI DrawThemeBackgroundEx(HTHEME htheme, HDC hdc, int part_id, int state_id,
+                                     LPCRECT rect, const DTBGOPTS *options)
 {
-    TRACE("(%p, %d, %d, %d, %d, %p)\n", htheme, part_id, state_id_from, state_id_to, prop_id,
-          duration);
+    HRESULT hr;
+    uxgtk_theme_t *theme;
 
-    return E_NOTIMPL;
+    TRACE("(%p, %p, %d, %d, %p, %p)\n", htheme, hdc, part_id, state_id, rect, options);
+
+    if (libgtk3 == NULL)
+        return E_NOTIMPL;
+
+    theme = uxgtk_handle_get(htheme);
+    if (theme == NULL)
+        return E_HANDLE;
+
+    hr = draw_part_background(theme, hdc, part_id, state_id, rect, options);
+
+    uxgtk_handle_put(htheme);
+
+    return hr;
 }
 
-BOOL WINAPI GetThemeSysBool(HTHEME htheme, int bool_id)
+/* Drops the handle references of the first count items and frees the array */
+static void release_batch(const DTBGBATCHITEM *items, uxgtk_theme_t **themes, UINT count)
 {
-    TRACE("(%p, %d)\n", htheme, bool_id);
+    UINT i;
 
-    SetLastError(ERROR_NOT_SUPPORTED);
+    for (i = 0; i < count; i++)
+        uxgtk_handle_put(items[i].hTheme);
 
-    return FALSE;
+    free(themes);
 }
 
-COLORREF WINAPI GetThemeSysColor(HTHEME htheme, int color_id)
+/*
+ * Draws several parts at once. They are composited in order into one
+ * DIB section covering all of them, which is then painted only once.
+ * Works best for adjacent parts like tabs or header items.
+ */
+HRESULT WINAPI DrawThemeBackgroundBatch(HDC hdc, const DTBGBATCHITEM *items, UINT count)
 {
+    UINT i;
     HRESULT hr = S_OK;
-    COLORREF color = 0;
-
-    static HTHEME window_htheme = NULL;
-    static HTHEME button_htheme = NULL;
-    static HTHEME edit_htheme = NULL;
-    static HTHEME menu_htheme = NULL;
+    BOOL opaque;
+    RECT bounds, visible, area;
+    uxgtk_dib_t *target, *dib;
+    int y, src_x, src_y, width, height;
+    ULONGLONG parts_area = 0;
+    uxgtk_theme_t **themes;
 
-    TRACE("(%p, %d)\n", htheme, color_id);
+    TRACE("(%p, %p, %u)\n", hdc, items, count);
 
     if (libgtk3 == NULL)
-        return GetSysColor(color_id);
-
-    if (window_htheme == NULL)
-    {
-        window_htheme = OpenThemeData(NULL, VSCLASS_WINDOW);
-        button_htheme = OpenThemeData(NULL, VSCLASS_BUTTON);
-        edit_htheme = OpenThemeData(NULL, VSCLASS_EDIT);
-        menu_htheme = OpenThemeData(NULL, VSCLASS_MENU);
-    }
-
-    switch (color_id)
-    {
-        case COLOR_BTNFACE:
-        case COLOR_SCROLLBAR:
-        case COLOR_WINDOWFRAME:
-        case COLOR_INACTIVECAPTION:
-        case COLOR_GRADIENTINACTIVECAPTION:
-        case COLOR_3DDKSHADOW:
-        case COLOR_BTNHIGHLIGHT:
-        case COLOR_ACTIVEBORDER:
-        case COLOR_INACTIVEBORDER:
-        case COLOR_APPWORKSPACE:
-        case COLOR_BACKGROUND:
-        case COLOR_ACTIVECAPTION:
-        case COLOR_GRADIENTACTIVECAPTION:
-        case COLOR_ALTERNATEBTNFACE:
-        case COLOR_INFOBK: /* FIXME */
-            hr = GetThemeColor(window_htheme, WP_DIALOG, 0, TMT_FILLCOLOR, &color);
-            break;
+        return E_NOTIMPL;
 
-        case COLOR_3DLIGHT:
-        case COLOR_BTNSHADOW:
-            hr = GetThemeColor(button_htheme, BP_PUSHBUTTON, PBS_NORMAL, TMT_BORDERCOLOR, &color);
-            break;
+    if (count == 0)
+        return S_OK;
 
-        case COLOR_BTNTEXT:
-        case COLOR_INFOTEXT:
-        case COLOR_WINDOWTEXT:
-        case COLOR_CAPTIONTEXT:
-            hr = GetThemeColor(window_htheme, WP_DIALOG, 0, TMT_TEXTCOLOR, &color);
-            break;
+    if (items == NULL || count > ~(SIZE_T)0 / sizeof(*themes))
+        return E_INVALIDARG;
 
-        case COLOR_HIGHLIGHTTEXT:
-            hr = GetThemeColor(edit_htheme, EP_EDITTEXT, ETS_SELECTED, TMT_TEXTCOLOR, &color);
-            break;
+    /* The handles are looked up once and kept until the end, see release_batch */
+    themes = malloc(count * sizeof(*themes));
+    if (themes == NULL)
+        return E_OUTOFMEMORY;
 
-        case COLOR_GRAYTEXT:
-        case COLOR_INACTIVECAPTIONTEXT:
-            hr = GetThemeColor(button_htheme, BP_PUSHBUTTON, PBS_DISABLED, TMT_TEXTCOLOR, &color);
-            break;
+    SetRectEmpty(&bounds);
 
-        case COLOR_HIGHLIGHT:
-        case COLOR_MENUHILIGHT:
-        case COLOR_HOTLIGHT:
-            hr = GetThemeColor(edit_htheme, EP_EDITTEXT, ETS_SELECTED, TMT_FILLCOLOR, &color);
-            break;
+    for (i = 0; i < count; i++)
+    {
+        themes[i] = uxgtk_handle_get(items[i].hTheme);
 
-        case COLOR_MENUBAR:
-            hr = GetThemeColor(menu_htheme, MENU_BARBACKGROUND, MB_ACTIVE, TMT_FILLCOLOR, &color);
-            break;
+        if (themes[i] == NULL)
+        {
+            release_batch(items, themes, i);
+            return E_HANDLE;
+        }
 
-        case COLOR_MENU:
-            hr = GetThemeColor(menu_htheme, MENU_POPUPBACKGROUND, 0, TMT_FILLCOLOR, &color);
-            break;
+        if (themes[i]->vtable == NULL)
+        {
+            release_batch(items, themes, i + 1);
+            return E_HANDLE;
+        }
 
-        case COLOR_MENUTEXT:
-            hr = GetThemeColor(menu_htheme, MENU_POPUPITEM, MPI_NORMAL, TMT_TEXTCOLOR, &color);
-            break;
+        if (themes[i]->vtable->draw_background == NULL)
+        {
+            release_batch(items, themes, i + 1);
+            return E_NOTIMPL;
+        }
 
-        case COLOR_WINDOW:
-            hr = GetThemeColor(edit_htheme, EP_EDITTEXT, ETS_NORMAL, TMT_FILLCOLOR, &color);
-            break;
+        if (!IsRectEmpty(&items[i].rc))
+            parts_area += (ULONGLONG)(items[i].rc.right - items[i].rc.left) *
+                          (items[i].rc.bottom - items[i].rc.top);
 
-        default:
-            FIXME("Unknown color %d.\n", color_id);
-            return GetSysColor(color_id);
+        UnionRect(&bounds, &bounds, &items[i].rc);
     }
 
-    if (FAILED(hr))
-        return GetSysColor(color_id);
+    /* Like parts in opposite corners, compositing the gap between them costs too much */
+    if ((ULONGLONG)(bounds.right - bounds.left) * (bounds.bottom - bounds.top) >
+        parts_area * BATCH_MAX_SPARSENESS)
+    {
+        release_batch(items, themes, count);
 
-    return color;
-}
+        for (i = 0; i < count; i++)
+        {
+            hr = DrawThemeBackground(items[i].hTheme, hdc, items[i].iPartId, items[i].iStateId,
+                                     &items[i].rc, NULL);
 
-HBRUSH WINAPI GetThemeSysColorBrush(HTHEME htheme, int color_id)
-{
-    TRACE("(%p, %d)\n", htheme, color_id);
+            if (FAILED(hr))
+                break;
+        }
 
-    return CreateSolidBrush(GetThemeSysColor(htheme, color_id));
-}
+        return hr;
+    }
 
-HRESULT WINAPI GetThemeSysFont(HTHEME htheme, int font_id, LOGFONTW *font)
-{
-    TRACE("(%p, %d, %p)\n", htheme, font_id, font);
+    if (!get_visible_rect(hdc, &bounds, NULL, &bounds))
+    {
+        release_batch(items, themes, count);
+        return S_OK;
+    }
 
-    return E_NOTIMPL;
-}
+    width = bounds.right - bounds.left;
+    height = bounds.bottom - bounds.top;
 
-HRESULT WINAPI GetThemeSysInt(HTHEME htheme, int int_id, int *value)
-{
-    TRACE("(%p, %d, %p)\n", htheme, int_id, value);
+    target = uxgtk_dib_acquire(width, height);
 
-    return E_NOTIMPL;
-}
+    if (target == NULL)
+    {
+        release_batch(items, themes, count);
+        return E_OUTOFMEMORY;
+    }
 
-int WINAPI GetThemeSysSize(HTHEME htheme, int size_id)
-{
-    TRACE("(%p, %d)\n", htheme, size_id);
- 
-    SetLastError(ERROR_NOT_SUPPORTED);
+    for (y = 0; y < height; y++)
+        memset(target->bits + y * target->stride, 0, width * 4);
 
-    return -1;
-}
+    for (i = 0; i < count; i++)
+    {
+        const RECT *rect = &items[i].rc;
 
-HRESULT WINAPI GetThemeSysString(HTHEME htheme, int string_id,
-                                 LPWSTR buffer, int maxlen)
-{
-    TRACE("(%p, %d, %p, %d)\n", htheme, string_id, buffer, maxlen);
+        if (!IntersectRect(&visible, rect, &bounds))
+            continue;
 
-    return E_NOTIMPL;
-}
+        area = visible;
+        OffsetRect(&area, -rect->left, -rect->top);
 
-HRESULT WINAPI DrawThemeBackground(HTHEME htheme, HDC hdc, int part_id, int state_id,
-                                   LPCRECT rect, LPCRECT clip_rect)
-{
-    DTBGOPTS opts;
+        hr = render_part(themes[i], items[i].iPartId, items[i].iStateId,
+                         rect->right - rect->left, rect->bottom - rect->top, &area,
+                         &dib, &src_x, &src_y, &opaque);
 
-    TRACE("(%p, %p, %d, %d, %p, %p)\n", htheme, hdc, part_id, state_id, rect, clip_rect);
+        if (FAILED(hr))
+            break;
 
-    opts.dwSize = sizeof(DTBGOPTS);
-    opts.dwFlags = 0;
+        uxgtk_pixels_blend(target->bits + (visible.top - bounds.top) * target->stride +
+                           (visible.left - bounds.left) * 4, target->stride,
+                           dib->bits + src_y * dib->stride + src_x * 4, dib->stride,
+                           visible.right - visible.left, visible.bottom - visible.top);
 
-    if (clip_rect != NULL)
+        uxgtk_dib_release(dib);
+    }
+
+    if (SUCCEEDED(hr))
     {
-        opts.dwFlags = DTBG_CLIPRECT;
-        CopyRect(&opts.rcClip, clip_rect);
+        opaque = uxgtk_pixels_opaque(target->bits, target->stride, width, height);
+        paint_dib(target, 0, 0, hdc, bounds.left, bounds.top, width, height, opaque);
     }
 
-    return DrawThemeBackgroundEx(htheme, hdc, part_id, state_id, rect, &opts);
+    uxgtk_dib_release(target);
+    release_batch(items, themes, count);
+
+    return hr;
 }
 
-HRESULT WINAPI DrawThemeBackgroundEx(HTHEME htheme, HDC hdc, int part_id, int state_id,
-                                     LPCRECT rect, const DTBGOPTS *options)
+static void prewarm_part(uxgtk_theme_t *theme, int part_id, int state_id, int width, int height)
 {
-    HRESULT hr;
-    cairo_t *cr;
-    cairo_surface_t *surface;
-    int x, y, width, height;
-    uxgtk_theme_t *theme = (uxgtk_theme_t *)htheme;
-
-    TRACE("(%p, %p, %d, %d, %p, %p)\n", htheme, hdc, part_id, state_id, rect, options);
-
-    if (libgtk3 == NULL)
-        return E_NOTIMPL;
-
-    if (theme == NULL || theme->vtable == NULL)
-        return E_HANDLE;
+    BOOL opaque;
+    RECT area;
+    uxgtk_dib_t *dib;
+    int src_x, src_y;
 
     if (theme->vtable->draw_background == NULL)
-        return E_NOTIMPL;
+        return;
 
-    width = rect->right - rect->left;
-    height = rect->bottom - rect->top;
+    SetRect(&area, 0, 0, width, height);
 
-    surface = pcairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
-    cr = pcairo_create(surface);
+    /* This puts the part into the cache */
+    if (SUCCEEDED(render_part(theme, part_id, state_id, width, height, &area,
+                              &dib, &src_x, &src_y, &opaque)))
+        uxgtk_dib_release(dib);
+}
 
-    hr = theme->vtable->draw_background(theme, cr, part_id, state_id, width, height);
+/* Runs on the render thread while it's idle, does one small thing per call */
+static BOOL prewarm_step(void)
+{
+    unsigned int position = prewarm_position++;
+    int index;
 
-    if (FAILED(hr))
-        goto free_cairo;
+    if (position < NUM_CLASSES)
+    {
+        prototypes[position] = acquire_class_theme(position);
+        return TRUE;
+    }
 
-    x = rect->left;
-    y = rect->top;
+    position -= NUM_CLASSES;
 
-    paint_cairo_surface(surface, hdc, x, y, width, height);
+    if (position >= sizeof(prewarm_parts) / sizeof(prewarm_parts[0]))
+    {
+        TRACE("Prewarming done.\n");
+        return FALSE;
+    }
 
-free_cairo:
+    index = find_class_in_list(prewarm_parts[position].classname);
 
-    pcairo_destroy(cr);
-    pcairo_surface_destroy(surface);
+    if (index >= 0 && prototypes[index] != NULL)
+        prewarm_part(prototypes[index], prewarm_parts[position].part_id,
+                     prewarm_parts[position].state_id, prewarm_parts[position].width,
+                     prewarm_parts[position].height);
 
-    return hr;
+    return TRUE;
 }
 
 HRESULT WINAPI DrawThemeEdge(HTHEME htheme, HDC hdc, int part_id, int state_id,
@@ -1104,26 +2587,69 @@ HRESULT WINAPI GetThemeBackgroundRegion(HTHEME htheme, HDC hdc, int part_id, int
     return E_NOTIMPL;
 }
 
+struct get_part_size_args
+{
+    uxgtk_theme_t *theme;
+    int part_id;
+    int state_id;
+    RECT *rect;
+    SIZE *size;
+    HRESULT hr;
+};
+
+static void get_part_size_proc(void *data)
+{
+    struct get_part_size_args *args = data;
+
+    args->hr = args->theme->vtable->get_part_size(args->theme, args->part_id, args->state_id,
+                                                  args->rect, args->size);
+}
+
+static HRESULT get_part_size(uxgtk_theme_t *theme, int part_id, int state_id,
+                             RECT *rect, SIZE *size)
+{
+    struct get_part_size_args args;
+
+    if (theme->vtable == NULL)
+        return E_HANDLE;
+
+    if (theme->vtable->get_part_size == NULL)
+        return E_NOTIMPL;
+
+    if (rect == NULL || size == NULL)
+        return E_INVALIDARG;
+
+    args.theme = theme;
+    args.part_id = part_id;
+    args.state_id = state_id;
+    args.rect = rect;
+    args.size = size;
+
+    uxgtk_render_call(get_part_size_proc, &args);
+
+    return args.hr;
+}
+
 HRESULT WINAPI GetThemePartSize(HTHEME htheme, HDC hdc, int part_id, int state_id,
                                 RECT *rect, THEMESIZE type, SIZE *size)
 {
-    uxgtk_theme_t *theme = (uxgtk_theme_t *)htheme;
+    HRESULT hr;
+    uxgtk_theme_t *theme;
 
     TRACE("(%p, %p, %d, %d, %p, %d, %p)\n", htheme, hdc, part_id, state_id, rect, type, size);
 
     if (libgtk3 == NULL)
         return E_NOTIMPL;
 
-    if (theme == NULL || theme->vtable == NULL)
+    theme = uxgtk_handle_get(htheme);
+    if (theme == NULL)
         return E_HANDLE;
 
-    if (theme->vtable->get_part_size == NULL)
-        return E_NOTIMPL;
+    hr = get_part_size(theme, part_id, state_id, rect, size);
 
-    if (rect == NULL || size == NULL)
-        return E_INVALIDARG;
+    uxgtk_handle_put(htheme);
 
-    return theme->vtable->get_part_size(theme, part_id, state_id, rect, size);
+    return hr;
 }
 
 HRESULT WINAPI GetThemeTextExtent(HTHEME htheme, HDC hdc, int part_id, int state_id,
@@ -1159,14 +2685,34 @@ HRESULT WINAPI HitTestThemeBackground(HTHEME htheme, HDC hdc, int part_id, int s
 
 BOOL WINAPI IsThemeBackgroundPartiallyTransparent(HTHEME htheme, int part_id, int state_id)
 {
+    const uxgtk_theme_vtable_t *vtable;
+    uxgtk_theme_t *theme;
+
     TRACE("(%p, %d, %d)\n", htheme, part_id, state_id);
 
-    return TRUE; /* The most widgets are partially transparent */
+    if (libgtk3 == NULL)
+        return TRUE;
+
+    theme = uxgtk_handle_get(htheme);
+    if (theme == NULL)
+        return TRUE;
+
+    /* The vtable is static, so it outlives the handle */
+    vtable = theme->vtable;
+    uxgtk_handle_put(htheme);
+
+    if (vtable == NULL)
+        return TRUE;
+
+    /* Parts which were never drawn yet are assumed to be partially transparent
+     * like the most widgets are */
+    return uxgtk_opacity_query(vtable, part_id, state_id) != UXGTK_OPACITY_OPAQUE;
 }
 
 BOOL WINAPI IsThemePartDefined(HTHEME htheme, int part_id, int state_id)
 {
-    uxgtk_theme_t *theme = (uxgtk_theme_t *)htheme;
+    const uxgtk_theme_vtable_t *vtable = NULL;
+    uxgtk_theme_t *theme;
 
     TRACE("(%p, %d, %d)\n", htheme, part_id, state_id);
 
@@ -1176,19 +2722,27 @@ BOOL WINAPI IsThemePartDefined(HTHEME htheme, int part_id, int state_id)
         return FALSE;
     }
 
-    if (theme == NULL || theme->vtable == NULL)
+    theme = uxgtk_handle_get(htheme);
+    if (theme != NULL)
+    {
+        /* The vtable is static, so it outlives the handle */
+        vtable = theme->vtable;
+        uxgtk_handle_put(htheme);
+    }
+
+    if (vtable == NULL)
     {
         SetLastError(ERROR_INVALID_HANDLE);
         return FALSE;
     }
 
-    if (theme->vtable->is_part_defined == NULL)
+    if (vtable->is_part_defined == NULL)
     {
         SetLastError(ERROR_NOT_SUPPORTED);
         return FALSE;
     }
 
-    return theme->vtable->is_part_defined(part_id, state_id);
+    return vtable->is_part_defined(part_id, state_id);
 }
 
 DWORD WINAPI QueryThemeServices(void)
@@ -1250,6 +2804,8 @@ HRESULT WINAPI EnumThemes(LPCWSTR themepath, EnumThemeProc callback, LPVOID data
 {
     TRACE("(%s, %p, %p)\n", debugstr_w(themepath), callback, data);
 
+    ensure_fake_theme();
+
     /* FIXME: check path */
     callback(NULL, fake_msstyles_file, FAKE_NAME, FAKE_NAME, NULL, data);
 
@@ -1323,6 +2879,12 @@ BOOL WINAPI DllMain(HINSTANCE hinstance, DWORD reason, LPVOID reserved)
         case DLL_PROCESS_DETACH:
             uninit();
             return TRUE;
+
+        case DLL_THREAD_DETACH:
+            uxgtk_cache_thread_detach();
+            uxgtk_dib_thread_detach();
+            uxgtk_render_thread_detach();
+            return TRUE;
     }
 
     return FALSE;
@@ -25,6 +25,8 @@
 
 #include <gtk/gtk.h>
 
+#include "wine/list.h"
+
 typedef struct _uxgtk_theme uxgtk_theme_t;
 typedef struct _uxgtk_theme_vtable uxgtk_theme_vtable_t;
 
@@ -37,14 +39,21 @@ struct _uxgtk_theme_vtable
     HRESULT (*get_part_size)(uxgtk_theme_t *theme, int part_id, int state_id,
                              RECT *rect, SIZE *size);
     BOOL (*is_part_defined)(int part_id, int state_id);
+    /* The context of the frame of a stretchable part or NULL, see render_part */
+    GtkStyleContext *(*get_stretch_context)(uxgtk_theme_t *theme, int part_id, int state_id);
 };
 
 struct _uxgtk_theme
 {
     const uxgtk_theme_vtable_t *vtable;
+    int refcount; /* the handles of all controls of a class, see uxtheme.c */
+    unsigned int class_index;
 
     GtkWidget *window;
     GtkWidget *layout;
+
+    struct list styles; /* see style.c */
+    struct list nodes;
 };
 
 typedef HANDLE HTHEMEFILE;
@@ -56,6 +65,15 @@ typedef struct tagTHEMENAMES
     WCHAR szTooltip[MAX_PATH+1];
 } THEMENAMES, *PTHEMENAMES;
 
+/* An item for DrawThemeBackgroundBatch */
+typedef struct tagDTBGBATCHITEM
+{
+    HANDLE hTheme; /* HTHEME */
+    int iPartId;
+    int iStateId;
+    RECT rc;
+} DTBGBATCHITEM, *PDTBGBATCHITEM;
+
 typedef BOOL (CALLBACK *EnumThemeProc)(LPVOID, LPCWSTR, LPCWSTR, LPCWSTR, LPVOID, LPVOID);
 typedef BOOL (CALLBACK *ParseThemeIniFileProc)(DWORD, LPWSTR, LPWSTR, LPWSTR, DWORD, LPVOID);
 
@@ -63,28 +81,35 @@ typedef BOOL (CALLBACK *ParseThemeIniFileProc)(DWORD, LPWSTR, LPWSTR, LPWSTR, DW
 MAKE_FUNCPTR(cairo_create);
 MAKE_FUNCPTR(cairo_destroy);
 MAKE_FUNCPTR(cairo_image_surface_create);
+MAKE_FUNCPTR(cairo_image_surface_create_for_data);
 MAKE_FUNCPTR(cairo_image_surface_get_data);
 MAKE_FUNCPTR(cairo_image_surface_get_stride);
 MAKE_FUNCPTR(cairo_surface_destroy);
 MAKE_FUNCPTR(cairo_surface_flush);
-MAKE_FUNCPTR(g_type_check_instance_is_a);
-MAKE_FUNCPTR(gtk_bin_get_child);
+MAKE_FUNCPTR(cairo_translate);
+MAKE_FUNCPTR(g_object_get);
+MAKE_FUNCPTR(g_object_unref);
+MAKE_FUNCPTR(g_signal_connect_data);
+MAKE_FUNCPTR(gtk_arrow_get_type);
+MAKE_FUNCPTR(gtk_box_get_type);
+MAKE_FUNCPTR(gtk_button_get_type);
 MAKE_FUNCPTR(gtk_button_new);
 MAKE_FUNCPTR(gtk_check_button_new);
-MAKE_FUNCPTR(gtk_combo_box_new_with_entry);
+MAKE_FUNCPTR(gtk_combo_box_get_type);
 MAKE_FUNCPTR(gtk_container_add);
-MAKE_FUNCPTR(gtk_container_forall);
+MAKE_FUNCPTR(gtk_events_pending);
+MAKE_FUNCPTR(gtk_entry_get_type);
 MAKE_FUNCPTR(gtk_entry_new);
 MAKE_FUNCPTR(gtk_fixed_new);
 MAKE_FUNCPTR(gtk_frame_new);
 MAKE_FUNCPTR(gtk_init);
 MAKE_FUNCPTR(gtk_label_new);
-MAKE_FUNCPTR(gtk_menu_bar_new);
-MAKE_FUNCPTR(gtk_menu_item_new);
-MAKE_FUNCPTR(gtk_menu_item_set_submenu);
-MAKE_FUNCPTR(gtk_menu_new);
-MAKE_FUNCPTR(gtk_menu_shell_append);
+MAKE_FUNCPTR(gtk_main_iteration_do);
+MAKE_FUNCPTR(gtk_menu_bar_get_type);
+MAKE_FUNCPTR(gtk_menu_get_type);
+MAKE_FUNCPTR(gtk_menu_item_get_type);
 MAKE_FUNCPTR(gtk_notebook_new);
+MAKE_FUNCPTR(gtk_offscreen_window_new);
 MAKE_FUNCPTR(gtk_radio_button_new);
 MAKE_FUNCPTR(gtk_render_arrow);
 MAKE_FUNCPTR(gtk_render_background);
@@ -97,28 +122,36 @@ MAKE_FUNCPTR(gtk_render_slider);
 MAKE_FUNCPTR(gtk_scale_new);
 MAKE_FUNCPTR(gtk_scrolled_window_new);
 MAKE_FUNCPTR(gtk_separator_tool_item_new);
+MAKE_FUNCPTR(gtk_settings_get_default);
 MAKE_FUNCPTR(gtk_style_context_add_class);
-MAKE_FUNCPTR(gtk_style_context_add_region);
+MAKE_FUNCPTR(gtk_style_context_get);
 MAKE_FUNCPTR(gtk_style_context_get_background_color);
+MAKE_FUNCPTR(gtk_style_context_get_border);
 MAKE_FUNCPTR(gtk_style_context_get_border_color);
 MAKE_FUNCPTR(gtk_style_context_get_color);
+MAKE_FUNCPTR(gtk_style_context_get_parent);
+MAKE_FUNCPTR(gtk_style_context_get_path);
+MAKE_FUNCPTR(gtk_style_context_get_state);
 MAKE_FUNCPTR(gtk_style_context_get_style);
-MAKE_FUNCPTR(gtk_style_context_remove_class);
-MAKE_FUNCPTR(gtk_style_context_restore);
-MAKE_FUNCPTR(gtk_style_context_save);
+MAKE_FUNCPTR(gtk_style_context_new);
 MAKE_FUNCPTR(gtk_style_context_set_junction_sides);
+MAKE_FUNCPTR(gtk_style_context_set_parent);
+MAKE_FUNCPTR(gtk_style_context_set_path);
 MAKE_FUNCPTR(gtk_style_context_set_state);
 MAKE_FUNCPTR(gtk_toggle_button_get_type);
 MAKE_FUNCPTR(gtk_toolbar_new);
-MAKE_FUNCPTR(gtk_tree_view_append_column);
-MAKE_FUNCPTR(gtk_tree_view_column_get_button);
-MAKE_FUNCPTR(gtk_tree_view_column_new);
-MAKE_FUNCPTR(gtk_tree_view_get_column);
-MAKE_FUNCPTR(gtk_tree_view_new);
+MAKE_FUNCPTR(gtk_tree_view_get_type);
 MAKE_FUNCPTR(gtk_widget_destroy);
+MAKE_FUNCPTR(gtk_widget_get_parent);
+MAKE_FUNCPTR(gtk_widget_get_path);
 MAKE_FUNCPTR(gtk_widget_get_style_context);
+MAKE_FUNCPTR(gtk_widget_path_append_type);
+MAKE_FUNCPTR(gtk_widget_path_copy);
+MAKE_FUNCPTR(gtk_widget_path_free);
+MAKE_FUNCPTR(gtk_widget_path_iter_add_class);
+MAKE_FUNCPTR(gtk_widget_path_iter_add_region);
+MAKE_FUNCPTR(gtk_widget_path_iter_set_object_name);
 MAKE_FUNCPTR(gtk_widget_style_get);
-MAKE_FUNCPTR(gtk_window_new);
 #undef MAKE_FUNCPTR
 
 uxgtk_theme_t *uxgtk_button_theme_create(void);
@@ -137,4 +170,129 @@ uxgtk_theme_t *uxgtk_window_theme_create(void);
 
 void uxgtk_theme_init(uxgtk_theme_t *theme, const uxgtk_theme_vtable_t *vtable);
 
+/* Style contexts with a fixed state, see style.c */
+typedef struct _uxgtk_style_desc
+{
+    GtkWidget *widget; /* the path and the parent are taken from it */
+    GtkStyleContext *node; /* or from this one if there is no widget */
+    GtkStateFlags state;
+    const char *classes[2]; /* added to the widget ones, unused are NULL */
+    const char *region;
+    GtkRegionFlags region_flags;
+    GtkJunctionSides junction_sides;
+} uxgtk_style_desc_t;
+
+GtkStyleContext *uxgtk_style_get(uxgtk_theme_t *theme, GtkWidget *widget, GtkStateFlags state,
+                                 const char *style_class);
+GtkStyleContext *uxgtk_style_get_ex(uxgtk_theme_t *theme, const uxgtk_style_desc_t *desc);
+GtkStyleContext *uxgtk_style_get_node(uxgtk_theme_t *theme, GtkStyleContext *node,
+                                      GtkStateFlags state, const char *style_class);
+GtkStyleContext *uxgtk_style_node_new(uxgtk_theme_t *theme, GtkStyleContext *parent, GType type,
+                                      const char *name, const char *style_class);
+int uxgtk_style_get_slice_inset(GtkStyleContext *context);
+void uxgtk_style_flush(uxgtk_theme_t *theme);
+void uxgtk_style_free(uxgtk_theme_t *theme);
+
+/* Rendered parts cache, see cache.c */
+typedef struct _uxgtk_cache_key
+{
+    const uxgtk_theme_vtable_t *vtable; /* identifies the theme class */
+    int part_id;
+    int state_id;
+    int width;
+    int height;
+} uxgtk_cache_key_t;
+
+typedef struct _uxgtk_bitmap
+{
+    int width;
+    int height;
+    int stride;
+    unsigned char *data; /* premultiplied ARGB32, top-down */
+    BOOL opaque;
+} uxgtk_bitmap_t;
+
+typedef enum _uxgtk_opacity
+{
+    UXGTK_OPACITY_UNKNOWN = 0,
+    UXGTK_OPACITY_OPAQUE,
+    UXGTK_OPACITY_TRANSPARENT
+} uxgtk_opacity_t;
+
+typedef void (*uxgtk_cache_read_func_t)(const uxgtk_bitmap_t *bitmap, void *context);
+
+BOOL uxgtk_cache_accepts(int width, int height);
+BOOL uxgtk_cache_lookup(const uxgtk_cache_key_t *key, uxgtk_cache_read_func_t func,
+                        void *context);
+BOOL uxgtk_cache_insert(const uxgtk_cache_key_t *key, const unsigned char *data, int stride,
+                        BOOL opaque);
+void uxgtk_cache_flush(void);
+void uxgtk_cache_thread_detach(void);
+void uxgtk_cache_init(void);
+void uxgtk_cache_uninit(void);
+void uxgtk_opacity_update(const uxgtk_theme_vtable_t *vtable, int part_id, int state_id,
+                          BOOL opaque);
+uxgtk_opacity_t uxgtk_opacity_query(const uxgtk_theme_vtable_t *vtable, int part_id,
+                                    int state_id);
+
+/* Pixel kernels, see pixel.c */
+BOOL uxgtk_pixels_opaque(const unsigned char *bits, int stride, int width, int height);
+void uxgtk_pixels_blend(unsigned char *dst, int dst_stride,
+                        const unsigned char *src, int src_stride, int width, int height);
+void uxgtk_pixels_copy(unsigned char *dst, int dst_stride,
+                       const unsigned char *src, int src_stride, int width, int height);
+void uxgtk_pixels_mix(unsigned char *dst, int dst_stride,
+                      const unsigned char *a, int a_stride,
+                      const unsigned char *b, int b_stride, int width, int height, int weight);
+
+/* Per-thread pool of memory DCs with DIB sections, see dib.c */
+typedef struct _uxgtk_dib
+{
+    HDC hdc;
+    HBITMAP bitmap;
+    HBITMAP old_bitmap;
+    unsigned char *bits;
+    int width;
+    int height;
+    int stride;
+    int bpp;
+    BOOL top_down;
+    DWORD last_used;
+    struct _dib_pool *pool; /* of the thread which acquired it */
+    struct list entry;
+} uxgtk_dib_t;
+
+uxgtk_dib_t *uxgtk_dib_acquire(int width, int height);
+uxgtk_dib_t *uxgtk_dib_acquire_format(int width, int height, int bpp, BOOL top_down);
+void uxgtk_dib_release(uxgtk_dib_t *dib);
+void uxgtk_dib_thread_detach(void);
+void uxgtk_dib_init(void);
+void uxgtk_dib_uninit(void);
+
+/* Theme handles and the themes of the windows, see handle.c */
+HANDLE uxgtk_handle_alloc(uxgtk_theme_t *theme);
+uxgtk_theme_t *uxgtk_handle_get(HANDLE handle);
+void uxgtk_handle_put(HANDLE handle);
+uxgtk_theme_t *uxgtk_handle_free(HANDLE handle);
+HANDLE uxgtk_window_get_theme(HWND hwnd);
+HANDLE uxgtk_window_get_texture(HWND hwnd);
+void uxgtk_window_set_theme(HWND hwnd, HANDLE theme);
+void uxgtk_window_set_texture(HWND hwnd, HANDLE texture);
+void uxgtk_handle_uninit(void);
+
+/* GTK render thread, see render.c */
+typedef void (*uxgtk_render_proc_t)(void *data);
+typedef BOOL (*uxgtk_idle_proc_t)(void);
+
+void uxgtk_render_call(uxgtk_render_proc_t proc, void *data);
+void uxgtk_render_set_idle(uxgtk_idle_proc_t proc);
+void uxgtk_render_set_timer(uxgtk_idle_proc_t proc, DWORD delay);
+void uxgtk_render_thread_detach(void);
+void uxgtk_render_init(uxgtk_render_proc_t startup);
+void uxgtk_render_uninit(void);
+
+/* Nine-slice scaler, see stretch.c */
+BOOL uxgtk_stretch_nine_slice(const uxgtk_bitmap_t *src, int border, int width, int height,
+                              const RECT *area, unsigned char *dst, int dst_stride);
+
 #endif /* UXTHEMEGTK_H */
@@ -83,6 +83,7 @@
 
 # Drawing
 @ stdcall DrawThemeBackground(ptr ptr long long ptr ptr)
+@ stdcall DrawThemeBackgroundBatch(ptr ptr long)
 @ stdcall DrawThemeBackgroundEx(ptr ptr long long ptr ptr)
 @ stdcall DrawThemeEdge(ptr ptr long long ptr long long ptr)
 @ stdcall DrawThemeIcon(ptr ptr long long ptr ptr long)
@@ -97,3 +98,19 @@
 @ stdcall HitTestThemeBackground(ptr long long long long ptr long int64 ptr)
 @ stdcall IsThemeBackgroundPartiallyTransparent(ptr long long)
 @ stdcall IsThemePartDefined(ptr long long)
+
+# Buffered paint
+@ stdcall BeginBufferedAnimation(ptr ptr ptr long ptr ptr ptr ptr)
+@ stdcall BeginBufferedPaint(ptr ptr long ptr ptr)
+@ stdcall BufferedPaintClear(ptr ptr)
+@ stdcall BufferedPaintInit()
+@ stdcall BufferedPaintRenderAnimation(ptr ptr)
+@ stdcall BufferedPaintSetAlpha(ptr ptr long)
+@ stdcall BufferedPaintStopAllAnimations(ptr)
+@ stdcall BufferedPaintUnInit()
+@ stdcall EndBufferedAnimation(ptr long)
+@ stdcall EndBufferedPaint(ptr long)
+@ stdcall GetBufferedPaintBits(ptr ptr ptr)
+@ stdcall GetBufferedPaintDC(ptr)
+@ stdcall GetBufferedPaintTargetDC(ptr)
+@ stdcall GetBufferedPaintTargetRect(ptr ptr)
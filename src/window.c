@@ -46,7 +46,8 @@ static const uxgtk_theme_vtable_t window_vtable = {
     get_color,
     draw_background,
     NULL, /* get_part_size */
-    is_part_defined
+    is_part_defined,
+    NULL /* get_stretch_context */
 };
 
 static HRESULT get_fill_color(uxgtk_theme_t *theme, int part_id, int state_id, GdkRGBA *rgba)
@@ -60,7 +61,7 @@ static HRESULT get_fill_color(uxgtk_theme_t *theme, int part_id, int state_id, G
     {
         case WP_DIALOG:
             state = GTK_STATE_FLAG_NORMAL;
-            context = pgtk_widget_get_style_context(theme->window);
+            context = uxgtk_style_get(theme, theme->window, state, GTK_STYLE_CLASS_BACKGROUND);
             break;
 
         default:
@@ -84,7 +85,7 @@ static HRESULT get_text_color(uxgtk_theme_t *theme, int part_id, int state_id, G
     {
         case WP_DIALOG:
             state = GTK_STATE_FLAG_NORMAL;
-            context = pgtk_widget_get_style_context(theme->window);
+            context = uxgtk_style_get(theme, theme->window, state, GTK_STYLE_CLASS_BACKGROUND);
             break;
 
         default:
@@ -122,7 +123,8 @@ static HRESULT draw_dialog(uxgtk_theme_t *theme, cairo_t *cr, int state_id, int
 
     assert(theme != NULL);
 
-    context = pgtk_widget_get_style_context(theme->window);
+    context = uxgtk_style_get(theme, theme->window, GTK_STATE_FLAG_NORMAL,
+                              GTK_STYLE_CLASS_BACKGROUND);
 
     pgtk_render_background(context, cr, 0, 0, width, height);
 
@@ -150,7 +152,6 @@ static BOOL is_part_defined(int part_id, int state_id)
 uxgtk_theme_t *uxgtk_window_theme_create(void)
 {
     window_theme_t *theme;
-    GtkStyleContext *context;
 
     TRACE("()\n");
 
@@ -159,8 +160,5 @@ uxgtk_theme_t *uxgtk_window_theme_create(void)
 
     uxgtk_theme_init(&theme->base, &window_vtable);
 
-    context = pgtk_widget_get_style_context(theme->base.window);
-    pgtk_style_context_add_class(context, GTK_STYLE_CLASS_BACKGROUND);
-
     return &theme->base;
 }